@@ -8,17 +8,19 @@
 
 int main() {
     constexpr size_t n = 4 * 256 * 256 * 256;
+    radix_sort_options device_opts;
+    device_opts.backend = radix_sort_backend::device;
     {
-        sycl::queue q{sycl::gpu_selector_v};
+        sycl::queue q{sycl::cpu_selector_v};
         std::cerr << q.get_device().get_info<sycl::info::device::name>() << std::endl;
         std::vector<unsigned> arr(n);
-        for (int i = 0; i < arr.size(); i++) {
+        for (size_t i = 0; i < arr.size(); i++) {
             arr[i] = wangshash(i)();
         }
         TICK(radix);
         {
             sycl::buffer<unsigned> buf{arr};
-            radix_sort(q, buf);
+            radix_sort(q, buf, device_opts);
         }
         TOCK(radix);
         if (auto it = std::is_sorted_until(arr.begin(), arr.end()); it == arr.end()) {
@@ -29,8 +31,27 @@ int main() {
         }
     }
     {
+        sycl::queue q{sycl::cpu_selector_v};
         std::vector<unsigned> arr(n);
-        for (int i = 0; i < arr.size(); i++) {
+        for (size_t i = 0; i < arr.size(); i++) {
+            arr[i] = wangshash(i)();
+        }
+        TICK(onesweep);
+        {
+            sycl::buffer<unsigned> buf{arr};
+            radix_sort<radix_sort_engine::onesweep>(q, buf, device_opts);
+        }
+        TOCK(onesweep);
+        if (auto it = std::is_sorted_until(arr.begin(), arr.end()); it == arr.end()) {
+            printf("sorted successfully\n");
+        } else {
+            printf("not sorted since %ld\n", it - arr.begin());
+            print_buffer(arr);
+        }
+    }
+    {
+        std::vector<unsigned> arr(n);
+        for (size_t i = 0; i < arr.size(); i++) {
             arr[i] = wangshash(i)();
         }
         TICK(tbb);
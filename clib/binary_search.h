@@ -0,0 +1,222 @@
+#pragma once
+
+#include <sycl/sycl.hpp>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include "device_memory.h"
+#include "merge.h"
+
+template <int ipt, bool upper, class H, class HQ, class HR, class Comp>
+class KT_binary_search;
+template <bool upper, class H, class HQ, class HR, class Comp>
+class KT_binary_search_merge;
+
+// queries every work-item answers in the cached search of unsorted
+// queries; sorted queries that take the merge are split by merge-path
+// co-ranking instead: every tile binary searches its diagonal of the merge
+// of queries and haystack for how many of its outputs come from each, so
+// all work-groups merge equal shares however the queries cluster
+inline constexpr int binary_search_items_per_thread = 8;
+
+// splitters of the haystack every work-group caches in local memory
+inline constexpr size_t binary_search_cached_keys = 1024;
+
+enum class query_order {
+    // any order: one search per query, the first levels in local memory
+    unsorted,
+    // ascending under the same comp as the haystack: dense query sets are
+    // answered by one merge of queries and haystack instead
+    sorted,
+};
+
+namespace _binary_search_details {
+
+// a merged element and where it came from
+template <class T>
+struct tagged {
+    T value;
+    size_t index;
+};
+
+// the first i of [lo, hi) with !before(hay[i]), hi if none
+template <class Hay, class Before>
+size_t partition_point(Hay const &hay, size_t lo, size_t hi, Before before) {
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (before(hay[mid]))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// every work-group caches every step-th key of the haystack, a search finds
+// the gap between two cached keys in local memory and only searches that
+// gap in global memory: about log2(binary_search_cached_keys) fewer global
+// reads per query
+template <int ipt, bool upper, class M, class H, class HQ, class HR, class Comp>
+void search_cached(M &mem, H &hay, HQ &queries, HR &result, Comp comp) {
+    using T = typename H::value_type;
+    using I = typename HR::value_type;
+    size_t n = hay.size();
+    size_t nq = queries.size();
+    size_t tiles = (nq + 256 * ipt - 1) / (256 * ipt);
+    size_t step = std::max<size_t>((n + binary_search_cached_keys - 1) / binary_search_cached_keys, 1);
+    size_t cached = (n + step - 1) / step;
+    mem.submit([&] (sycl::handler &cgh) {
+        sycl::local_accessor<T> top{std::max<size_t>(cached, 1), cgh};
+        auto h = M::read(cgh, hay);
+        auto qs = M::read(cgh, queries);
+        auto r = M::write(cgh, result);
+        cgh.parallel_for<KT_binary_search<ipt, upper, H, HQ, HR, Comp>>(sycl::nd_range<1>{tiles * 256, 256}, [=] (sycl::nd_item<1> it) {
+            int ii = it.get_local_id(0);
+            int gi = it.get_group(0);
+            for (size_t j = ii; j < cached; j += 256) {
+                top[j] = h[j * step];
+            }
+            it.barrier(sycl::access::fence_space::local_space);
+            for (int k = 0; k < ipt; k++) {
+                size_t i = (size_t)gi * 256 * ipt + k * 256 + ii;
+                if (i >= nq)
+                    break;
+                T q = qs[i];
+                auto before = [&] (T const &x) {
+                    return upper ? !comp(q, x) : comp(x, q);
+                };
+                // top[j - 1] is the last cached key before q
+                size_t j = partition_point(top, 0, cached, before);
+                size_t pos = j == 0 ? 0 : partition_point(h, (j - 1) * step + 1, std::min(j * step, n), before);
+                r[i] = static_cast<I>(pos);
+            }
+        });
+    });
+}
+
+// the position of a sorted query in the merge of queries and haystack, less
+// the queries before it, is its bound: for lower_bound the queries go first
+// among equal keys, for upper_bound the haystack does
+template <bool upper, class M, class H, class HQ, class HR, class Comp>
+void search_merged(M &mem, H &hay, HQ &queries, HR &result, Comp comp) {
+    using T = typename H::value_type;
+    using I = typename HR::value_type;
+    size_t n = hay.size();
+    size_t nq = queries.size();
+    size_t na = upper ? n : nq;
+    auto tagged_comp = [comp] (tagged<T> const &a, tagged<T> const &b) {
+        return comp(a.value, b.value);
+    };
+    using Name = KT_binary_search_merge<upper, H, HQ, HR, Comp>;
+    _merge_details::merge_runs<merge_items_per_thread, Name>(mem, n + nq, n + nq, na, [&] (sycl::handler &cgh) {
+        auto h = M::read(cgh, hay);
+        auto qs = M::read(cgh, queries);
+        auto r = M::write(cgh, result);
+        return _merge_details::merge_io{[=] (size_t k) {
+            if (upper)
+                return tagged<T>{k < n ? h[k] : qs[k - n], k};
+            return tagged<T>{k < nq ? qs[k] : h[k - nq], k};
+        }, [=] (size_t p, tagged<T> const &x) {
+            if (upper && x.index >= n)
+                r[x.index - n] = static_cast<I>(p - (x.index - n));
+            if (!upper && x.index < nq)
+                r[x.index] = static_cast<I>(p - x.index);
+        }};
+    }, tagged_comp);
+}
+
+template <int ipt, bool upper, class M, class H, class HQ, class HR, class Comp>
+void search(M &mem, H &hay, HQ &queries, HR &result, Comp comp, query_order order) {
+    size_t n = hay.size();
+    size_t nq = queries.size();
+    if (nq == 0) return;
+    if (n == 0) {
+        mem.fill(result, typename HR::value_type{0});
+        return;
+    }
+    // a merge reads every key once, the searches log2(n) keys per query
+    if (order == query_order::sorted && nq * std::log2((double)n) > n + nq)
+        search_merged<upper>(mem, hay, queries, result, comp);
+    else
+        search_cached<ipt, upper>(mem, hay, queries, result, comp);
+}
+
+}
+
+// result[i] = the first position of the sorted hay whose key is not before
+// (lower_bound) or is after (upper_bound) queries[i] under comp, for all
+// queries at once; with order == sorted a dense query set takes the merge
+template <int ipt = binary_search_items_per_thread, class T, class I, class Comp = std::less<>>
+void lower_bound(sycl::queue &q, sycl::buffer<T> &hay, sycl::buffer<T> &queries, sycl::buffer<I> &result,
+                 query_order order = query_order::unsorted, Comp comp = {}) {
+    buffer_memory mem{q};
+    _binary_search_details::search<ipt, false>(mem, hay, queries, result, comp, order);
+}
+
+template <int ipt = binary_search_items_per_thread, class T, class I, class Comp = std::less<>>
+void upper_bound(sycl::queue &q, sycl::buffer<T> &hay, sycl::buffer<T> &queries, sycl::buffer<I> &result,
+                 query_order order = query_order::unsorted, Comp comp = {}) {
+    buffer_memory mem{q};
+    _binary_search_details::search<ipt, true>(mem, hay, queries, result, comp, order);
+}
+
+// [lower[i], upper[i]) are the positions of the keys of hay equivalent to
+// queries[i]
+template <int ipt = binary_search_items_per_thread, class T, class I, class Comp = std::less<>>
+void equal_range(sycl::queue &q, sycl::buffer<T> &hay, sycl::buffer<T> &queries, sycl::buffer<I> &lower,
+                 sycl::buffer<I> &upper, query_order order = query_order::unsorted, Comp comp = {}) {
+    buffer_memory mem{q};
+    _binary_search_details::search<ipt, false>(mem, hay, queries, lower, comp, order);
+    _binary_search_details::search<ipt, true>(mem, hay, queries, upper, comp, order);
+}
+
+template <int ipt = binary_search_items_per_thread, class T, class I, class Comp = std::less<>>
+sycl::event lower_bound(sycl::queue &q, T const *hay, size_t n, T const *queries, size_t nq, I *result,
+                        query_order order = query_order::unsorted, Comp comp = {},
+                        std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<T> h{const_cast<T *>(hay), n};
+    usm_span<T> qs{const_cast<T *>(queries), nq};
+    usm_span<I> r{result, nq};
+    _binary_search_details::search<ipt, false>(mem, h, qs, r, comp, order);
+    return mem.finish();
+}
+
+template <int ipt = binary_search_items_per_thread, class T, class I, class Comp = std::less<>>
+sycl::event upper_bound(sycl::queue &q, T const *hay, size_t n, T const *queries, size_t nq, I *result,
+                        query_order order = query_order::unsorted, Comp comp = {},
+                        std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<T> h{const_cast<T *>(hay), n};
+    usm_span<T> qs{const_cast<T *>(queries), nq};
+    usm_span<I> r{result, nq};
+    _binary_search_details::search<ipt, true>(mem, h, qs, r, comp, order);
+    return mem.finish();
+}
+
+template <int ipt = binary_search_items_per_thread, class T, class I, class Comp = std::less<>>
+sycl::event equal_range(sycl::queue &q, T const *hay, size_t n, T const *queries, size_t nq, I *lower, I *upper,
+                        query_order order = query_order::unsorted, Comp comp = {},
+                        std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<T> h{const_cast<T *>(hay), n};
+    usm_span<T> qs{const_cast<T *>(queries), nq};
+    usm_span<I> lo{lower, nq};
+    usm_span<I> hi{upper, nq};
+    _binary_search_details::search<ipt, false>(mem, h, qs, lo, comp, order);
+    _binary_search_details::search<ipt, true>(mem, h, qs, hi, comp, order);
+    return mem.finish();
+}
+
+// bytes of temp_storage the USM searches of nq queries of T in n keys need,
+// only the merge of sorted queries needs any
+template <int ipt = binary_search_items_per_thread, class T, class I = size_t>
+size_t binary_search_temp_storage_bytes(sycl::queue &q, size_t n, size_t nq, query_order order = query_order::unsorted) {
+    usm_memory mem{q, usm_memory::measure_tag{}};
+    usm_span<T> h{nullptr, n};
+    usm_span<T> qs{nullptr, nq};
+    usm_span<I> r{nullptr, nq};
+    _binary_search_details::search<ipt, true>(mem, h, qs, r, std::less<>{}, order);
+    return mem.used_bytes();
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <sycl/sycl.hpp>
+#include <vector>
+#include <functional>
+#include "device_memory.h"
+#include "exclusive_scan.h"
+
+template <class H, class HO, class Pred>
+class KT_copy_if;
+template <class H, class HO, class Pred>
+class KT_partition;
+template <class HO>
+class KT_partition_reverse;
+template <class H, class HO, class Eq>
+class KT_unique;
+
+namespace _compact_details {
+
+// copies the in[i] with keep(i) to the front of out in order and their
+// number to count[0], in one look-back scan over the keep flags: the scan
+// hands every element its output position as it is stored; with
+// keep_rejected the others fill out[count[0], n) from the back, last first
+template <int ipt, class Name, bool keep_rejected = false, class M, class H, class HO, class HC, class BindKeep>
+void compact(M &mem, H &in, HO &out, HC &count, BindKeep bind_keep) {
+    size_t n = in.size();
+    if (n == 0) {
+        mem.fill(count, size_t{0});
+        return;
+    }
+    _exclusive_scan_details::scan_lookback<false, ipt, Name>(mem, n, [&] (sycl::handler &cgh) {
+        auto keep = bind_keep(cgh);
+        auto a = M::read(cgh, in);
+        auto o = M::read_write(cgh, out);
+        auto c = M::write(cgh, count);
+        return _exclusive_scan_details::scan_io{[=] (size_t i) -> size_t {
+            return keep(i);
+        }, [=] (size_t i, size_t pos) {
+            bool k = keep(i);
+            if (k)
+                o[pos] = a[i];
+            else if (keep_rejected)
+                o[n - 1 - (i - pos)] = a[i];
+            if (i == n - 1)
+                c[0] = pos + k;
+        }};
+    }, true, size_t{0}, std::plus<>{});
+}
+
+template <class M, class H, class Pred>
+auto bind_pred(H &in, Pred pred) {
+    return [&in, pred] (sycl::handler &cgh) {
+        auto a = M::read(cgh, in);
+        return [=] (size_t i) -> bool {
+            return pred(a[i]);
+        };
+    };
+}
+
+template <class M, class H, class Eq>
+auto bind_first_of_run(H &in, Eq eq) {
+    return [&in, eq] (sycl::handler &cgh) {
+        auto a = M::read(cgh, in);
+        return [=] (size_t i) -> bool {
+            return i == 0 || !eq(a[i - 1], a[i]);
+        };
+    };
+}
+
+template <int ipt, class M, class H, class HO, class HC, class Pred>
+void copy_if(M &mem, H &in, HO &out, HC &count, Pred pred) {
+    compact<ipt, KT_copy_if<H, HO, Pred>>(mem, in, out, count, bind_pred<M>(in, pred));
+}
+
+template <int ipt, class M, class H, class HO, class HC, class Eq>
+void unique(M &mem, H &in, HO &out, HC &count, Eq eq) {
+    compact<ipt, KT_unique<H, HO, Eq>>(mem, in, out, count, bind_first_of_run<M>(in, eq));
+}
+
+// reverses out[count[0], n), the rejected elements compact stored last first
+template <class M, class HO, class HC>
+void reverse_tail(M &mem, HO &out, size_t n, HC &count) {
+    mem.submit([&] (sycl::handler &cgh) {
+        auto o = M::read_write(cgh, out);
+        auto c = M::read(cgh, count);
+        cgh.parallel_for<KT_partition_reverse<HO>>(sycl::range<1>{n / 2}, [=] (sycl::id<1> id) {
+            size_t j = id[0];
+            size_t begin = c[0];
+            if (j < (n - begin) / 2)
+                std::swap(o[begin + j], o[n - 1 - j]);
+        });
+    });
+}
+
+// the selected elements go to the front as in copy_if and the rejected ones
+// to the back in the same pass, where they only need reversing once the
+// scan has counted the selected ones
+template <int ipt, class M, class H, class HO, class HC, class Pred>
+void partition(M &mem, H &in, HO &out, HC &count, Pred pred) {
+    size_t n = in.size();
+    compact<ipt, KT_partition<H, HO, Pred>, true>(mem, in, out, count, bind_pred<M>(in, pred));
+    if (n > 1)
+        reverse_tail(mem, out, n, count);
+}
+
+}
+
+// stream compaction into a separate out of at least as many elements as
+// in; count[0] gets the number of elements written (partition: selected)
+// on the device, so no host read blocks. All three are a single pass over
+// in, partition is stable and then reverses its rejected elements in out
+template <int ipt = scan_items_per_thread, class T, class Pred>
+void copy_if(sycl::queue &q, sycl::buffer<T> &in, sycl::buffer<T> &out, sycl::buffer<size_t> &count, Pred pred) {
+    buffer_memory mem{q};
+    _compact_details::copy_if<ipt>(mem, in, out, count, pred);
+}
+
+template <int ipt = scan_items_per_thread, class T, class Pred>
+void partition(sycl::queue &q, sycl::buffer<T> &in, sycl::buffer<T> &out, sycl::buffer<size_t> &count, Pred pred) {
+    buffer_memory mem{q};
+    _compact_details::partition<ipt>(mem, in, out, count, pred);
+}
+
+// keeps the first element of every run of equal neighbours
+template <int ipt = scan_items_per_thread, class T, class Eq = std::equal_to<>>
+void unique(sycl::queue &q, sycl::buffer<T> &in, sycl::buffer<T> &out, sycl::buffer<size_t> &count, Eq eq = {}) {
+    buffer_memory mem{q};
+    _compact_details::unique<ipt>(mem, in, out, count, eq);
+}
+
+template <int ipt = scan_items_per_thread, class T, class Pred>
+sycl::event copy_if(sycl::queue &q, T const *in, size_t n, T *out, size_t *count, Pred pred,
+                    std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<T> s{const_cast<T *>(in), n};
+    usm_span<T> o{out, n};
+    usm_span<size_t> c{count, 1};
+    _compact_details::copy_if<ipt>(mem, s, o, c, pred);
+    return mem.finish();
+}
+
+template <int ipt = scan_items_per_thread, class T, class Pred>
+sycl::event partition(sycl::queue &q, T const *in, size_t n, T *out, size_t *count, Pred pred,
+                      std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<T> s{const_cast<T *>(in), n};
+    usm_span<T> o{out, n};
+    usm_span<size_t> c{count, 1};
+    _compact_details::partition<ipt>(mem, s, o, c, pred);
+    return mem.finish();
+}
+
+template <int ipt = scan_items_per_thread, class T, class Eq = std::equal_to<>>
+sycl::event unique(sycl::queue &q, T const *in, size_t n, T *out, size_t *count, Eq eq = {},
+                   std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<T> s{const_cast<T *>(in), n};
+    usm_span<T> o{out, n};
+    usm_span<size_t> c{count, 1};
+    _compact_details::unique<ipt>(mem, s, o, c, eq);
+    return mem.finish();
+}
+
+// bytes of temp_storage any of the USM compactions of n elements needs
+template <int ipt = scan_items_per_thread, class T>
+size_t compact_temp_storage_bytes(sycl::queue &q, size_t n) {
+    usm_memory mem{q, usm_memory::measure_tag{}};
+    usm_span<T> s{nullptr, n};
+    usm_span<T> o{nullptr, n};
+    usm_span<size_t> c{nullptr, 1};
+    _compact_details::partition<ipt>(mem, s, o, c, [] (T const &) { return true; });
+    return mem.used_bytes();
+}
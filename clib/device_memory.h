@@ -0,0 +1,308 @@
+#pragma once
+
+#include <sycl/sycl.hpp>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+
+// a USM allocation seen as a sized array, the USM counterpart of sycl::buffer
+template <class T>
+struct usm_span {
+    using value_type = T;
+
+    T *ptr;
+    size_t n;
+
+    size_t size() const {
+        return n;
+    }
+};
+
+// keeps freed device blocks in power-of-two buckets so repeated calls of
+// similar size stop allocating after warm-up; a block handed back with the
+// event of its last use is given out again together with that event, and
+// the next user depends on it instead of the host waiting for it
+class caching_device_allocator {
+public:
+    explicit caching_device_allocator(sycl::queue const &q) : ctx(q.get_context()), dev(q.get_device()) {}
+
+    caching_device_allocator(caching_device_allocator const &) = delete;
+    caching_device_allocator &operator=(caching_device_allocator const &) = delete;
+
+    ~caching_device_allocator() {
+        for (auto &[bytes, blk]: free_blocks) {
+            blk.ready.wait();
+            sycl::free(blk.ptr, ctx);
+        }
+    }
+
+    std::pair<void *, sycl::event> allocate(size_t bytes) {
+        size_t bucket = 256;
+        while (bucket < bytes) bucket *= 2;
+        std::lock_guard<std::mutex> lck(mtx);
+        if (auto it = free_blocks.find(bucket); it != free_blocks.end()) {
+            block blk = it->second;
+            free_blocks.erase(it);
+            live.emplace(blk.ptr, bucket);
+            return {blk.ptr, blk.ready};
+        }
+        void *p = sycl::malloc_device(bucket, dev, ctx);
+        live.emplace(p, bucket);
+        return {p, sycl::event{}};
+    }
+
+    void deallocate(void *p, sycl::event ready) {
+        std::lock_guard<std::mutex> lck(mtx);
+        auto it = live.find(p);
+        free_blocks.emplace(it->second, block{p, ready});
+        live.erase(it);
+    }
+
+private:
+    struct block {
+        void *ptr;
+        sycl::event ready;
+    };
+
+    sycl::context ctx;
+    sycl::device dev;
+    std::mutex mtx;
+    std::multimap<size_t, block> free_blocks;
+    std::map<void *, size_t> live;
+};
+
+// where the USM overloads of clib take their temporaries from: carved out
+// of ptr[0, bytes) when ptr is set (size it with the matching
+// *_temp_storage_bytes query, and order calls sharing it through their
+// events), else from allocator when set, else sycl::malloc_device'd and
+// freed after the call
+struct temp_storage {
+    void *ptr = nullptr;
+    size_t bytes = 0;
+    caching_device_allocator *allocator = nullptr;
+};
+
+// the algorithms of clib are written once against a memory policy, so the
+// same kernel bodies serve sycl::buffer and USM arguments:
+//   handle<T>               sycl::buffer<T> or usm_span<T>
+//   alloc<T>(n)             a temporary of n elements
+//   submit(f)               q.submit(f) ordered after the previous submission
+//   read/write/read_write   an accessor for buffers, a raw pointer for USM
+//   fill, copy, to_host     the obvious, to_host waits for the data
+//   finish()                the event of the last submission
+//   is_measuring()          whether this only measures temp_storage
+class buffer_memory {
+public:
+    template <class T>
+    using handle = sycl::buffer<T>;
+
+    explicit buffer_memory(sycl::queue &q) : q(q) {}
+
+    sycl::queue &queue() {
+        return q;
+    }
+
+    template <class T>
+    sycl::buffer<T> alloc(size_t n) {
+        return sycl::buffer<T>{n};
+    }
+
+    template <class F>
+    sycl::event submit(F &&f) {
+        return last = q.submit(std::forward<F>(f));
+    }
+
+    template <class T>
+    static auto read(sycl::handler &cgh, sycl::buffer<T> &b) {
+        return sycl::accessor{b, cgh, sycl::read_only};
+    }
+
+    template <class T>
+    static auto write(sycl::handler &cgh, sycl::buffer<T> &b) {
+        return sycl::accessor{b, cgh, sycl::write_only, sycl::no_init};
+    }
+
+    template <class T>
+    static auto read_write(sycl::handler &cgh, sycl::buffer<T> &b) {
+        return sycl::accessor{b, cgh, sycl::read_write};
+    }
+
+    template <class T>
+    void fill(sycl::buffer<T> &b, T value) {
+        submit([&] (sycl::handler &cgh) {
+            sycl::accessor a{b, cgh, sycl::write_only, sycl::no_init};
+            cgh.fill(a, value);
+        });
+    }
+
+    template <class T>
+    void copy(sycl::buffer<T> &src, sycl::buffer<T> &dst) {
+        submit([&] (sycl::handler &cgh) {
+            sycl::accessor a{src, cgh, sycl::read_only};
+            sycl::accessor aout{dst, cgh, sycl::write_only, sycl::no_init};
+            cgh.copy(a, aout);
+        });
+    }
+
+    template <class T>
+    std::vector<T> to_host(sycl::buffer<T> &b) {
+        sycl::host_accessor<T> a{b, sycl::read_only};
+        return std::vector<T>(a.begin(), a.end());
+    }
+
+    sycl::event finish() {
+        return last;
+    }
+
+    bool is_measuring() const {
+        return false;
+    }
+
+private:
+    sycl::queue &q;
+    sycl::event last;
+};
+
+// every submission depends on the previous one (the first on the caller's
+// dependencies), so a chain of clib calls runs back to back even on an
+// out-of-order queue; temporaries are freed by a host task after the last
+// submission instead of blocking the caller
+class usm_memory {
+public:
+    template <class T>
+    using handle = usm_span<T>;
+
+    usm_memory(sycl::queue &q, std::vector<sycl::event> deps, temp_storage const &temp = {})
+        : q(q), deps(std::move(deps)), temp(temp) {}
+
+    struct measure_tag {};
+
+    // submits nothing and only adds up the bytes that alloc would carve out
+    // of a temp_storage, the data of to_host reads as zeros
+    usm_memory(sycl::queue &q, measure_tag) : q(q), measuring(true) {}
+
+    usm_memory(usm_memory const &) = delete;
+    usm_memory &operator=(usm_memory const &) = delete;
+
+    sycl::queue &queue() {
+        return q;
+    }
+
+    size_t used_bytes() const {
+        return used;
+    }
+
+    // the algorithms whose temporaries depend on the data take their worst
+    // case when measuring
+    bool is_measuring() const {
+        return measuring;
+    }
+
+    template <class T>
+    usm_span<T> alloc(size_t n) {
+        size_t bytes = (n * sizeof(T) + 255) / 256 * 256;
+        if (measuring || temp.ptr) {
+            size_t offset = used;
+            used += bytes;
+            if (measuring)
+                return {nullptr, n};
+            if (used > temp.bytes)
+                throw std::length_error("temp_storage smaller than its *_temp_storage_bytes query");
+            return {reinterpret_cast<T *>(static_cast<char *>(temp.ptr) + offset), n};
+        }
+        if (temp.allocator) {
+            auto [p, ready] = temp.allocator->allocate(bytes);
+            deps.push_back(ready);
+            cached.push_back(p);
+            return {static_cast<T *>(p), n};
+        }
+        T *p = sycl::malloc_device<T>(n, q);
+        temps.push_back(p);
+        return {p, n};
+    }
+
+    template <class F>
+    sycl::event submit(F &&f) {
+        if (measuring)
+            return sycl::event{};
+        sycl::event e = q.submit([&] (sycl::handler &cgh) {
+            cgh.depends_on(deps);
+            f(cgh);
+        });
+        deps = {e};
+        return e;
+    }
+
+    template <class T>
+    static T *read(sycl::handler &, usm_span<T> &s) {
+        return s.ptr;
+    }
+
+    template <class T>
+    static T *write(sycl::handler &, usm_span<T> &s) {
+        return s.ptr;
+    }
+
+    template <class T>
+    static T *read_write(sycl::handler &, usm_span<T> &s) {
+        return s.ptr;
+    }
+
+    template <class T>
+    void fill(usm_span<T> &s, T value) {
+        submit([&] (sycl::handler &cgh) {
+            cgh.fill(s.ptr, value, s.n);
+        });
+    }
+
+    template <class S, class T>
+    void copy(usm_span<S> &src, usm_span<T> &dst) {
+        submit([&] (sycl::handler &cgh) {
+            cgh.copy(src.ptr, dst.ptr, src.n);
+        });
+    }
+
+    template <class T>
+    std::vector<T> to_host(usm_span<T> &s) {
+        std::vector<T> v(s.n);
+        if (!measuring) {
+            submit([&] (sycl::handler &cgh) {
+                cgh.copy(s.ptr, v.data(), s.n);
+            }).wait();
+        }
+        return v;
+    }
+
+    sycl::event finish() {
+        if (measuring)
+            return sycl::event{};
+        if (!temps.empty()) {
+            submit([&] (sycl::handler &cgh) {
+                cgh.host_task([ctx = q.get_context(), temps = std::move(temps)] {
+                    for (void *p: temps) {
+                        sycl::free(p, ctx);
+                    }
+                });
+            });
+            temps.clear();
+        }
+        if (deps.size() != 1)
+            submit([] (sycl::handler &) {});
+        for (void *p: cached) {
+            temp.allocator->deallocate(p, deps.front());
+        }
+        cached.clear();
+        return deps.front();
+    }
+
+private:
+    sycl::queue &q;
+    std::vector<sycl::event> deps;
+    temp_storage temp;
+    bool measuring = false;
+    size_t used = 0;
+    std::vector<void *> temps;
+    std::vector<void *> cached;
+};
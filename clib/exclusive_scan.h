@@ -1,42 +1,375 @@
 #pragma once
 
 #include <sycl/sycl.hpp>
+#include <vector>
+#include <algorithm>
+#include "device_memory.h"
 
-class KT_exclusive_scan;
-class KT_exclusive_scan_paste;
+template <int ipt, class H, class Op, bool inclusive>
+class KT_scan_recursive_block;
+template <int ipt, class H, class Op, bool inclusive>
+class KT_scan_recursive_paste;
+template <int ipt, class Name, class Op, bool inclusive>
+class KT_scan_lookback;
 
-inline void exclusive_scan(sycl::queue &q, sycl::buffer<unsigned> &hist_group) {
-    if (hist_group.size() <= 1) return;
-    sycl::buffer<unsigned> glob_sum{(hist_group.size() + 255) / 256};
-    q.submit([&] (sycl::handler &cgh) {
-        sycl::accessor hist{hist_group, cgh, sycl::read_write};
-        sycl::accessor gsum{glob_sum, cgh, sycl::write_only, sycl::no_init};
-        cgh.parallel_for<KT_exclusive_scan>(sycl::nd_range<1>{glob_sum.size() * 256, 256}, [=] (sycl::nd_item<1> it) {
+enum class scan_engine {
+    // block scans, a recursive scan of the block totals, then a paste pass:
+    // about 2 log256(n) launches, but runs on any device
+    recursive,
+    // one launch reading and writing every element once: each tile takes
+    // its prefix from the preceding tiles by decoupled look-back, which
+    // needs work-groups to make independent forward progress
+    lookback,
+};
+
+// elements every work-item scans sequentially in registers, so only one
+// work-group scan is paid per 256 * ipt elements
+inline constexpr int scan_items_per_thread = 8;
+
+namespace _exclusive_scan_details {
+
+// inclusive scan of one value per work-item over a work-group of 256 with
+// any associative op (the group algorithms only take built-in operators),
+// the result of work-item ii is also left in loc[ii]
+template <class T, class Loc, class Op>
+T group_inclusive_scan(sycl::nd_item<1> const &it, Loc const &loc, T x, Op op) {
+    int ii = it.get_local_id(0);
+    loc[ii] = x;
+    for (int d = 1; d < 256; d *= 2) {
+        it.barrier(sycl::access::fence_space::local_space);
+        T y = ii >= d ? loc[ii - d] : x;
+        it.barrier(sycl::access::fence_space::local_space);
+        if (ii >= d) {
+            x = op(y, x);
+            loc[ii] = x;
+        }
+    }
+    it.barrier(sycl::access::fence_space::local_space);
+    return x;
+}
+
+// a tile of 256 * ipt elements gives every work-item a contiguous strip of
+// ipt; the strips are scanned in registers, then their totals across the
+// work-group, leaving x inclusive within the strip and loc[ii] the total
+// of strips 0..ii
+template <int ipt, class T, class Loc, class Op>
+void strip_scan(sycl::nd_item<1> const &it, Loc const &loc, T (&x)[ipt], Op op) {
+    for (int r = 1; r < ipt; r++) {
+        x[r] = op(x[r - 1], x[r]);
+    }
+    group_inclusive_scan(it, loc, x[ipt - 1], op);
+}
+
+// the tile of 256 * ipt elements at tile_base goes into x blocked, the
+// strip of work-item ii being elements ii * ipt onwards: consecutive lanes
+// read consecutive addresses into tile in local memory, then every
+// work-item takes its strip from there; elements past n repeat element n - 1
+template <int ipt, class T, class Tile, class Load>
+void load_blocked(sycl::nd_item<1> const &it, Tile const &tile, T (&x)[ipt], size_t tile_base, size_t n, Load load) {
+    int ii = it.get_local_id(0);
+    for (int r = 0; r < ipt; r++) {
+        size_t j = r * 256 + ii;
+        tile[j] = load(std::min(tile_base + j, n - 1));
+    }
+    it.barrier(sycl::access::fence_space::local_space);
+    for (int r = 0; r < ipt; r++) {
+        x[r] = tile[ii * ipt + r];
+    }
+    it.barrier(sycl::access::fence_space::local_space);
+}
+
+// the way back of load_blocked: store(i, y) for the elements i < n of the tile
+template <int ipt, class T, class Tile, class Store>
+void store_blocked(sycl::nd_item<1> const &it, Tile const &tile, T const (&y)[ipt], size_t tile_base, size_t n, Store store) {
+    int ii = it.get_local_id(0);
+    for (int r = 0; r < ipt; r++) {
+        tile[ii * ipt + r] = y[r];
+    }
+    it.barrier(sycl::access::fence_space::local_space);
+    for (int r = 0; r < ipt; r++) {
+        size_t j = r * 256 + ii;
+        if (tile_base + j < n)
+            store(tile_base + j, tile[j]);
+    }
+}
+
+// in place; an exclusive scan always has an init, an inclusive scan folds
+// init (if has_init) into its first element
+template <bool inclusive, int ipt, class M, class H, class Op>
+void scan_recursive(M &mem, H &data, bool has_init, typename H::value_type init, Op op) {
+    using T = typename H::value_type;
+    size_t n = data.size();
+    if (n == 0) return;
+    size_t groups = (n + 256 * ipt - 1) / (256 * ipt);
+    auto glob_sum = mem.template alloc<T>(groups);
+    mem.submit([&] (sycl::handler &cgh) {
+        sycl::local_accessor<T> loc{256, cgh};
+        sycl::local_accessor<T> tile{256 * ipt, cgh};
+        auto a = M::read_write(cgh, data);
+        auto gsum = M::write(cgh, glob_sum);
+        cgh.parallel_for<KT_scan_recursive_block<ipt, H, Op, inclusive>>(sycl::nd_range<1>{groups * 256, 256}, [=] (sycl::nd_item<1> it) {
             int ii = it.get_local_id(0);
             int gi = it.get_group(0);
-            int i = it.get_global_id(0);
-            unsigned val = sycl::inclusive_scan_over_group(it.get_group(), i < hist.size() ? hist[i] : 0u, std::plus<>{});
-            if (ii == 255) {
-                gsum[gi] = val;
-            } else if (i + 1 < hist.size()) {
-                hist[i + 1] = val;
+            size_t tile_base = (size_t)gi * 256 * ipt;
+            T x[ipt];
+            load_blocked(it, tile, x, tile_base, n, [=] (size_t i) {
+                return a[i];
+            });
+            if (inclusive && has_init && gi == 0 && ii == 0)
+                x[0] = op(init, x[0]);
+            strip_scan(it, loc, x, op);
+            if (ii > 0) {
+                for (int r = 0; r < ipt; r++) {
+                    x[r] = op(loc[ii - 1], x[r]);
+                }
             }
-            if (ii == 0) {
-                hist[i] = 0;
+            if (ii == 255)
+                gsum[gi] = loc[255];
+            store_blocked(it, tile, x, tile_base, n, [=] (size_t i, T const &v) {
+                a[i] = v;
+            });
+        });
+    });
+    if (groups > 1) {
+        // inclusive: group g is offset by the inclusive total of groups < g,
+        // exclusive: by init followed by the totals of groups < g
+        scan_recursive<inclusive, ipt>(mem, glob_sum, !inclusive, init, op);
+    } else if (inclusive) {
+        return;
+    }
+    mem.submit([&] (sycl::handler &cgh) {
+        auto a = M::read_write(cgh, data);
+        auto gsum = M::read(cgh, glob_sum);
+        // element-wise, so consecutive lanes take consecutive elements
+        cgh.parallel_for<KT_scan_recursive_paste<ipt, H, Op, inclusive>>(sycl::nd_range<1>{groups * 256, 256}, [=] (sycl::nd_item<1> it) {
+            int ii = it.get_local_id(0);
+            int gi = it.get_group(0);
+            size_t tile_base = (size_t)gi * 256 * ipt;
+            if constexpr (inclusive) {
+                for (int r = 0; r < ipt; r++) {
+                    size_t i = tile_base + r * 256 + ii;
+                    if (gi > 0 && i < n)
+                        a[i] = op(gsum[gi - 1], a[i]);
+                }
+            } else {
+                // shift by one: element i takes the group-local inclusive
+                // value of i - 1, which must be read before anyone writes
+                T prefix = groups > 1 ? gsum[gi] : init;
+                T prev[ipt];
+                for (int r = 0; r < ipt; r++) {
+                    size_t i = tile_base + r * 256 + ii;
+                    prev[r] = a[std::min(i, n) - (i > tile_base)];
+                }
+                it.barrier(sycl::access::fence_space::global_space);
+                for (int r = 0; r < ipt; r++) {
+                    size_t i = tile_base + r * 256 + ii;
+                    if (i < n)
+                        a[i] = i == tile_base ? prefix : op(prefix, prev[r]);
+                }
             }
         });
     });
-    if (glob_sum.size() > 1) {
-        exclusive_scan(q, glob_sum);
-        q.submit([&] (sycl::handler &cgh) {
-            sycl::accessor hist{hist_group, cgh, sycl::read_write};
-            sycl::accessor gsum{glob_sum, cgh, sycl::read_only};
-            cgh.parallel_for<KT_exclusive_scan_paste>(sycl::nd_range<1>{glob_sum.size() * 256, 256}, [=] (sycl::nd_item<1> it) {
-                int gi = it.get_group(0);
-                int i = it.get_global_id(0);
-                if (i < hist.size())
-                    hist[i] += gsum[gi];
+}
+
+inline constexpr unsigned tile_aggregate = 1;
+inline constexpr unsigned tile_prefix = 2;
+
+// the n elements a scan reads and writes, as bound to a command group by
+// the bind(cgh) argument of scan_lookback: load(i) -> T and store(i, T)
+template <class L, class S>
+struct scan_io {
+    L load;
+    S store;
+};
+template <class L, class S>
+scan_io(L, S) -> scan_io<L, S>;
+
+template <class M, class H>
+auto bind_in_place(H &data) {
+    return [&data] (sycl::handler &cgh) {
+        using T = typename H::value_type;
+        auto a = M::read_write(cgh, data);
+        return scan_io{[=] (size_t i) { return a[i]; }, [=] (size_t i, T v) { a[i] = v; }};
+    };
+}
+
+// Name tells the kernels of different bindings apart; without has_init the
+// exclusive result of element 0 is unspecified
+template <bool inclusive, int ipt, class Name, class T, class M, class Bind, class Op>
+void scan_lookback(M &mem, size_t n, Bind bind, bool has_init, T init, Op op) {
+    if (n == 0) return;
+    size_t tiles = (n + 256 * ipt - 1) / (256 * ipt);
+    // flags of every tile, then the counter handing out tile ids
+    auto flags = mem.template alloc<unsigned>(tiles + 1);
+    auto aggregates = mem.template alloc<T>(tiles);
+    auto prefixes = mem.template alloc<T>(tiles);
+    mem.fill(flags, 0u);
+    mem.submit([&] (sycl::handler &cgh) {
+        sycl::local_accessor<T> loc{256, cgh};
+        sycl::local_accessor<T> tile{256 * ipt, cgh};
+        sycl::local_accessor<T> tile_total{1, cgh};
+        sycl::local_accessor<T> tile_prefix_of{1, cgh};
+        sycl::local_accessor<unsigned> tile_id{1, cgh};
+        auto io = bind(cgh);
+        auto flg = M::read_write(cgh, flags);
+        auto agg = M::read_write(cgh, aggregates);
+        auto pre = M::read_write(cgh, prefixes);
+        cgh.parallel_for<KT_scan_lookback<ipt, Name, Op, inclusive>>(sycl::nd_range<1>{tiles * 256, 256}, [=] (sycl::nd_item<1> it) {
+            int ii = it.get_local_id(0);
+            // tiles are numbered in the order they start, so every tile a
+            // look-back waits on is already running and will make progress
+            if (ii == 0)
+                tile_id[0] = sycl::atomic_ref<unsigned, sycl::memory_order_relaxed, sycl::memory_scope_device>(flg[tiles]).fetch_add(1u);
+            it.barrier(sycl::access::fence_space::local_space);
+            size_t t = tile_id[0];
+            size_t tile_base = t * 256 * ipt;
+            size_t last = std::min<size_t>(n - tile_base, 256 * ipt) - 1;
+            T x[ipt];
+            load_blocked(it, tile, x, tile_base, n, [&] (size_t i) {
+                return io.load(i);
+            });
+            strip_scan(it, loc, x, op);
+            // the strips past n are padding, the tile ends at element last
+            if ((size_t)ii == last / ipt)
+                tile_total[0] = ii > 0 ? op(loc[ii - 1], x[last % ipt]) : x[last % ipt];
+            it.barrier(sycl::access::fence_space::local_space);
+            bool has_prefix = t > 0 || has_init;
+            if (ii == 0) {
+                T total = tile_total[0];
+                T prefix = init;
+                if (t > 0) {
+                    agg[t] = total;
+                    sycl::atomic_ref<unsigned, sycl::memory_order_acq_rel, sycl::memory_scope_device>(flg[t]).store(tile_aggregate);
+                    bool have = false;
+                    for (size_t j = t; j > 0;) {
+                        unsigned f = sycl::atomic_ref<unsigned, sycl::memory_order_acq_rel, sycl::memory_scope_device>(flg[j - 1]).load();
+                        if (f == 0)
+                            continue;
+                        T v = f == tile_prefix ? pre[j - 1] : agg[j - 1];
+                        prefix = have ? op(v, prefix) : v;
+                        have = true;
+                        if (f == tile_prefix)
+                            break;
+                        j--;
+                    }
+                }
+                pre[t] = has_prefix ? op(prefix, total) : total;
+                sycl::atomic_ref<unsigned, sycl::memory_order_acq_rel, sycl::memory_scope_device>(flg[t]).store(tile_prefix);
+                tile_prefix_of[0] = prefix;
+            }
+            it.barrier(sycl::access::fence_space::local_space);
+            // the prefix of this strip: the tile prefix, then strips 0..ii-1
+            T prefix = tile_prefix_of[0];
+            if (ii > 0) {
+                prefix = has_prefix ? op(prefix, loc[ii - 1]) : loc[ii - 1];
+                has_prefix = true;
+            }
+            T y[ipt];
+            for (int r = 0; r < ipt; r++) {
+                if constexpr (inclusive)
+                    y[r] = has_prefix ? op(prefix, x[r]) : x[r];
+                else
+                    y[r] = r == 0 ? prefix : has_prefix ? op(prefix, x[r - 1]) : x[r - 1];
+            }
+            store_blocked(it, tile, y, tile_base, n, [&] (size_t i, T const &v) {
+                io.store(i, v);
             });
         });
+    });
+}
+
+template <scan_engine engine, bool inclusive, int ipt, class M, class H, class Op>
+void scan(M &mem, H &data, bool has_init, typename H::value_type init, Op op) {
+    if constexpr (engine == scan_engine::lookback) {
+        scan_lookback<inclusive, ipt, H>(mem, data.size(), bind_in_place<M>(data), has_init, init, op);
+    } else {
+        scan_recursive<inclusive, ipt>(mem, data, has_init, init, op);
     }
 }
+
+template <class M>
+void exclusive_scan(M &mem, typename M::template handle<unsigned> &hist_group) {
+    scan_recursive<false, scan_items_per_thread>(mem, hist_group, true, 0u, std::plus<>{});
+}
+
+}
+
+inline void exclusive_scan(sycl::queue &q, sycl::buffer<unsigned> &hist_group) {
+    buffer_memory mem{q};
+    _exclusive_scan_details::exclusive_scan(mem, hist_group);
+}
+
+// scans n elements of device or shared USM in place once deps are done,
+// returns the event of the last kernel without waiting for it
+inline sycl::event exclusive_scan(sycl::queue &q, unsigned *data, size_t n, std::vector<sycl::event> const &deps = {},
+                                  temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<unsigned> s{data, n};
+    _exclusive_scan_details::exclusive_scan(mem, s);
+    return mem.finish();
+}
+
+// bytes of temp_storage the USM exclusive_scan of n elements needs
+inline size_t exclusive_scan_temp_storage_bytes(sycl::queue &q, size_t n) {
+    usm_memory mem{q, usm_memory::measure_tag{}};
+    usm_span<unsigned> s{nullptr, n};
+    _exclusive_scan_details::exclusive_scan(mem, s);
+    return mem.used_bytes();
+}
+
+// generic scans in place of any trivially copyable T under any associative
+// op: buf[i] becomes init op buf[0] op ... op buf[i - 1] for the exclusive
+// scan, and (init op) buf[0] op ... op buf[i] for the inclusive one
+template <scan_engine engine = scan_engine::lookback, int ipt = scan_items_per_thread, class T, class Op = std::plus<>>
+void exclusive_scan(sycl::queue &q, sycl::buffer<T> &buf, T init, Op op = {}) {
+    buffer_memory mem{q};
+    _exclusive_scan_details::scan<engine, false, ipt>(mem, buf, true, init, op);
+}
+
+template <scan_engine engine = scan_engine::lookback, int ipt = scan_items_per_thread, class T, class Op = std::plus<>>
+void inclusive_scan(sycl::queue &q, sycl::buffer<T> &buf, Op op = {}) {
+    buffer_memory mem{q};
+    _exclusive_scan_details::scan<engine, true, ipt>(mem, buf, false, T{}, op);
+}
+
+template <scan_engine engine = scan_engine::lookback, int ipt = scan_items_per_thread, class T, class Op>
+void inclusive_scan(sycl::queue &q, sycl::buffer<T> &buf, Op op, T init) {
+    buffer_memory mem{q};
+    _exclusive_scan_details::scan<engine, true, ipt>(mem, buf, true, init, op);
+}
+
+template <scan_engine engine = scan_engine::lookback, int ipt = scan_items_per_thread, class T, class Op = std::plus<>>
+sycl::event exclusive_scan(sycl::queue &q, T *data, size_t n, T init, Op op = {},
+                           std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<T> s{data, n};
+    _exclusive_scan_details::scan<engine, false, ipt>(mem, s, true, init, op);
+    return mem.finish();
+}
+
+template <scan_engine engine = scan_engine::lookback, int ipt = scan_items_per_thread, class T, class Op = std::plus<>>
+sycl::event inclusive_scan(sycl::queue &q, T *data, size_t n, Op op = {},
+                           std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<T> s{data, n};
+    _exclusive_scan_details::scan<engine, true, ipt>(mem, s, false, T{}, op);
+    return mem.finish();
+}
+
+template <scan_engine engine = scan_engine::lookback, int ipt = scan_items_per_thread, class T, class Op>
+sycl::event inclusive_scan(sycl::queue &q, T *data, size_t n, Op op, T init,
+                           std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<T> s{data, n};
+    _exclusive_scan_details::scan<engine, true, ipt>(mem, s, true, init, op);
+    return mem.finish();
+}
+
+// bytes of temp_storage the USM generic scans of n elements of T need
+template <scan_engine engine = scan_engine::lookback, int ipt = scan_items_per_thread, class T>
+size_t scan_temp_storage_bytes(sycl::queue &q, size_t n) {
+    usm_memory mem{q, usm_memory::measure_tag{}};
+    usm_span<T> s{nullptr, n};
+    _exclusive_scan_details::scan<engine, false, ipt>(mem, s, true, T{}, std::plus<>{});
+    return mem.used_bytes();
+}
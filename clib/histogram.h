@@ -0,0 +1,211 @@
+#pragma once
+
+#include <sycl/sycl.hpp>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
+#include "device_memory.h"
+#include "radix_sort.h"
+
+template <int ipt, class H, class BinOf>
+class KT_histogram_local;
+template <int ipt, class H, class BinOf>
+class KT_histogram_global;
+template <int ipt, class H, class BinOf>
+class KT_histogram_bins;
+template <int ipt, class H, class BinOf>
+class KT_histogram_runs;
+
+enum class histogram_strategy {
+    // local when the bins fit in local memory, global when they fit in the
+    // global memory cache, sort otherwise
+    automatic,
+    // a privatized sub-histogram per work-group in local memory, flushed
+    // with one global atomic per nonzero bin
+    local,
+    // one global atomic per element
+    global,
+    // the bins of all elements radix sorted, counts from the run boundaries
+    sort,
+};
+
+// elements every work-item bins per tile
+inline constexpr int histogram_items_per_thread = 16;
+
+// bins of equal width over [lo, hi), values outside fall into no bin; an
+// integer offset from lo is the unsigned difference in the width of T,
+// which cannot overflow, scaled in 64-bit integers (to 32 significant bits
+// for wider ranges), and a floating point one stays in T, so no kernel
+// needs fp64 for float keys
+template <class T>
+struct uniform_bins {
+    T lo;
+    T hi;
+    size_t bins;
+
+    size_t operator()(T x) const {
+        if (x < lo || !(x < hi))
+            return bins;
+        if constexpr (std::is_floating_point_v<T>) {
+            return std::min<size_t>((x - lo) / (hi - lo) * static_cast<T>(bins), bins - 1);
+        } else {
+            using U = std::make_unsigned_t<T>;
+            uint64_t offset = static_cast<U>(static_cast<U>(x) - static_cast<U>(lo));
+            uint64_t width = static_cast<U>(static_cast<U>(hi) - static_cast<U>(lo));
+            int s = width >> 32 ? 32 : 0;
+            return std::min<size_t>((offset >> s) * bins / (width >> s), bins - 1);
+        }
+    }
+};
+
+namespace _histogram_details {
+
+inline histogram_strategy choose_strategy(sycl::queue &q, size_t bins) {
+    sycl::device dev = q.get_device();
+    size_t bytes = bins * sizeof(unsigned);
+    // leave room for the occupancy of more than one work-group per core
+    if (bytes <= dev.get_info<sycl::info::device::local_mem_size>() / 2)
+        return histogram_strategy::local;
+    if (bytes <= dev.get_info<sycl::info::device::global_mem_cache_size>())
+        return histogram_strategy::global;
+    return histogram_strategy::sort;
+}
+
+// hist[b] = number of elements x with bin_of(x) == b, elements whose bin is
+// outside [0, hist.size()) are not counted
+template <int ipt, class M, class H, class HH, class BinOf>
+void histogram(M &mem, H &data, HH &hist, BinOf bin_of, histogram_strategy strategy) {
+    size_t n = data.size();
+    size_t bins = hist.size();
+    size_t tiles = (n + 256 * ipt - 1) / (256 * ipt);
+    if (strategy == histogram_strategy::automatic)
+        strategy = choose_strategy(mem.queue(), bins);
+    if (n == 0) {
+        mem.fill(hist, 0u);
+        return;
+    }
+    if (strategy == histogram_strategy::sort) {
+        // bins == the value of every uncounted element, sorted after the rest
+        auto mapped = mem.template alloc<unsigned>(n);
+        mem.submit([&] (sycl::handler &cgh) {
+            auto a = M::read(cgh, data);
+            auto m = M::write(cgh, mapped);
+            cgh.parallel_for<KT_histogram_bins<ipt, H, BinOf>>(sycl::range<1>{n}, [=] (sycl::id<1> i) {
+                size_t b = bin_of(a[i]);
+                m[i] = b < bins ? b : bins;
+            });
+        });
+        radix_sort_options opts;
+        opts.end_bit = 1;
+        while (opts.end_bit < 32 && (bins >> opts.end_bit))
+            opts.end_bit++;
+        _radix_sort_details::radix_sort_by_key<radix_sort_engine::classic, radix_sort_items_per_thread>(mem, opts, mapped);
+        mem.submit([&] (sycl::handler &cgh) {
+            auto m = M::read(cgh, mapped);
+            auto h = M::write(cgh, hist);
+            cgh.parallel_for<KT_histogram_runs<ipt, H, BinOf>>(sycl::range<1>{bins}, [=] (sycl::id<1> i) {
+                unsigned b = i[0];
+                auto lower_bound = [&] (unsigned v) {
+                    size_t lo = 0, hi = n;
+                    while (lo < hi) {
+                        size_t mid = (lo + hi) / 2;
+                        if (m[mid] < v)
+                            lo = mid + 1;
+                        else
+                            hi = mid;
+                    }
+                    return lo;
+                };
+                h[i] = lower_bound(b + 1) - lower_bound(b);
+            });
+        });
+        return;
+    }
+    mem.fill(hist, 0u);
+    if (strategy == histogram_strategy::global) {
+        mem.submit([&] (sycl::handler &cgh) {
+            auto a = M::read(cgh, data);
+            auto h = M::read_write(cgh, hist);
+            cgh.parallel_for<KT_histogram_global<ipt, H, BinOf>>(sycl::nd_range<1>{tiles * 256, 256}, [=] (sycl::nd_item<1> it) {
+                int ii = it.get_local_id(0);
+                int gi = it.get_group(0);
+                for (int r = 0; r < ipt; r++) {
+                    size_t i = (size_t)gi * 256 * ipt + r * 256 + ii;
+                    if (i < n) {
+                        size_t b = bin_of(a[i]);
+                        if (b < bins)
+                            atomic_ref<sycl::memory_order_relaxed, sycl::memory_scope_device>(h[b]).fetch_add(1u);
+                    }
+                }
+            });
+        });
+        return;
+    }
+    // a few work-groups per compute unit stride over all tiles, so every
+    // sub-histogram is flushed once for many tiles instead of once per tile
+    size_t groups = std::min<size_t>(tiles, mem.queue().get_device().template get_info<sycl::info::device::max_compute_units>() * 4);
+    mem.submit([&] (sycl::handler &cgh) {
+        sycl::local_accessor<unsigned> count{bins, cgh};
+        auto a = M::read(cgh, data);
+        auto h = M::read_write(cgh, hist);
+        cgh.parallel_for<KT_histogram_local<ipt, H, BinOf>>(sycl::nd_range<1>{groups * 256, 256}, [=] (sycl::nd_item<1> it) {
+            int ii = it.get_local_id(0);
+            int gi = it.get_group(0);
+            for (size_t b = ii; b < bins; b += 256) {
+                count[b] = 0;
+            }
+            it.barrier(sycl::access::fence_space::local_space);
+            for (size_t t = gi; t < tiles; t += groups) {
+                for (int r = 0; r < ipt; r++) {
+                    size_t i = t * 256 * ipt + r * 256 + ii;
+                    if (i < n) {
+                        size_t b = bin_of(a[i]);
+                        if (b < bins)
+                            atomic_ref(count[b]).fetch_add(1u);
+                    }
+                }
+            }
+            it.barrier(sycl::access::fence_space::local_space);
+            for (size_t b = ii; b < bins; b += 256) {
+                if (unsigned c = count[b])
+                    atomic_ref<sycl::memory_order_relaxed, sycl::memory_scope_device>(h[b]).fetch_add(c);
+            }
+        });
+    });
+}
+
+}
+
+// counts the elements of buf into hist.size() bins by bin_of(x), a bin
+// index convertible to size_t; elements mapped outside [0, hist.size())
+// are dropped
+template <int ipt = histogram_items_per_thread, class T, class BinOf>
+void histogram(sycl::queue &q, sycl::buffer<T> &buf, sycl::buffer<unsigned> &hist, BinOf bin_of,
+               histogram_strategy strategy = histogram_strategy::automatic) {
+    buffer_memory mem{q};
+    _histogram_details::histogram<ipt>(mem, buf, hist, bin_of, strategy);
+}
+
+template <int ipt = histogram_items_per_thread, class T, class BinOf>
+sycl::event histogram(sycl::queue &q, T const *data, size_t n, unsigned *hist, size_t bins, BinOf bin_of,
+                      histogram_strategy strategy = histogram_strategy::automatic,
+                      std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<T> s{const_cast<T *>(data), n};
+    usm_span<unsigned> h{hist, bins};
+    _histogram_details::histogram<ipt>(mem, s, h, bin_of, strategy);
+    return mem.finish();
+}
+
+// bytes of temp_storage the USM histogram of n elements into bins needs,
+// only the sort strategy needs any
+template <int ipt = histogram_items_per_thread, class T>
+size_t histogram_temp_storage_bytes(sycl::queue &q, size_t n, size_t bins,
+                                    histogram_strategy strategy = histogram_strategy::automatic) {
+    usm_memory mem{q, usm_memory::measure_tag{}};
+    usm_span<T> s{nullptr, n};
+    usm_span<unsigned> h{nullptr, bins};
+    _histogram_details::histogram<ipt>(mem, s, h, [] (T const &) { return size_t{0}; }, strategy);
+    return mem.used_bytes();
+}
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <tuple>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+#include "radix_traits.h"
+#if __has_include(<tbb/parallel_for.h>)
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+#define CLIB_HOST_RADIX_SORT_TBB 1
+#endif
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// the radix sort of radix_sort.h natively on the host: the same LSD passes
+// of 8-bit digits, with blocks of keys for work-groups and TBB tasks for
+// their scheduling; the keys of a digit are collected in cache-line sized
+// write-combining buffers before they hit the output
+namespace _host_radix_sort_details {
+
+// keys of a block, the unit of one histogram and one scatter task
+inline constexpr size_t block_size = 1 << 16;
+
+// bytes of the write-combining buffer of every digit, one cache line
+inline constexpr size_t write_combining_bytes = 64;
+
+// outputs of at least this many bytes take non-temporal stores for the
+// full lines of keys: they would not stay in cache for the next pass
+// anyway; about where streaming and cached stores break even on 32-bit keys
+inline constexpr size_t streaming_bytes = 4 << 20;
+
+template <class F>
+void for_each_block(size_t blocks, F f) {
+#ifdef CLIB_HOST_RADIX_SORT_TBB
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, blocks, 1), [&] (tbb::blocked_range<size_t> const &r) {
+        for (size_t b = r.begin(); b != r.end(); b++) {
+            f(b);
+        }
+    });
+#else
+    for (size_t b = 0; b < blocks; b++) {
+        f(b);
+    }
+#endif
+}
+
+// count[d] = keys of a[0, len) with digit d, spread over 4 tables so that
+// consecutive equal digits do not wait on each other's increments
+template <class T>
+void histogram(T const *a, size_t len, int shift, unsigned mask, size_t *count) {
+    uint32_t c[4][256] = {};
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        c[0][radix_digit(a[i], shift, mask)]++;
+        c[1][radix_digit(a[i + 1], shift, mask)]++;
+        c[2][radix_digit(a[i + 2], shift, mask)]++;
+        c[3][radix_digit(a[i + 3], shift, mask)]++;
+    }
+    for (; i < len; i++) {
+        c[0][radix_digit(a[i], shift, mask)]++;
+    }
+    for (int d = 0; d < 256; d++) {
+        count[d] = c[0][d] + c[1][d] + c[2][d] + c[3][d];
+    }
+}
+
+// copies one full cache line of keys to a 64-byte aligned dst, bypassing
+// the cache where the instruction set has non-temporal stores
+inline void stream_line(void *dst, void const *src) {
+#if defined(__AVX512F__)
+    _mm512_stream_si512(static_cast<__m512i *>(dst), _mm512_loadu_si512(src));
+#elif defined(__AVX2__)
+    auto s = static_cast<__m256i const *>(src);
+    auto d = static_cast<__m256i *>(dst);
+    _mm256_stream_si256(d, _mm256_loadu_si256(s));
+    _mm256_stream_si256(d + 1, _mm256_loadu_si256(s + 1));
+#else
+    std::memcpy(dst, src, write_combining_bytes);
+#endif
+}
+
+inline void stream_fence() {
+#if defined(__AVX512F__) || defined(__AVX2__)
+    _mm_sfence();
+#endif
+}
+
+// the write-combining buffers of one thread, wc keys and payloads per
+// digit, allocated once per sort and reused by every block of every pass
+template <class T, class ...Vs>
+struct write_combining {
+    static constexpr size_t wc = std::max<size_t>(write_combining_bytes / sizeof(T), 1);
+
+    std::vector<T> keys = std::vector<T>(256 * wc);
+    std::tuple<std::vector<Vs>...> values{std::vector<Vs>(256 * wc)...};
+};
+
+// writes every key of src[0, len) and its payloads to pos[digit]++ of dst:
+// each digit fills its write-combining buffer, which is flushed as one
+// contiguous run, so the output is written a cache line at a time instead
+// of one element into each of 256 open lines; the first flush of a digit
+// stops at a cache line boundary of dst, the later full ones are aligned
+// and streamed when stream is set
+template <class T, class ...Vs, size_t ...Is>
+void scatter(write_combining<T, Vs...> &buf, T const *src, size_t len, int shift, unsigned mask,
+             size_t *pos, T *dst, bool stream, [[maybe_unused]] std::tuple<Vs *...> vsrc,
+             [[maybe_unused]] std::tuple<Vs *...> vdst, std::index_sequence<Is...>) {
+    constexpr size_t wc = write_combining<T, Vs...>::wc;
+    constexpr bool line = wc * sizeof(T) == write_combining_bytes;
+    uint32_t fill[256];
+    uint32_t limit[256];
+    for (unsigned d = 0; d < 256; d++) {
+        fill[d] = 0;
+        size_t misalign = reinterpret_cast<uintptr_t>(dst + pos[d]) % write_combining_bytes;
+        limit[d] = line && misalign % sizeof(T) == 0 && misalign ? (write_combining_bytes - misalign) / sizeof(T) : wc;
+    }
+    auto flush = [&] (unsigned d, size_t m) {
+        if (line && stream && m == wc && reinterpret_cast<uintptr_t>(dst + pos[d]) % write_combining_bytes == 0)
+            stream_line(dst + pos[d], &buf.keys[d * wc]);
+        else
+            std::memcpy(dst + pos[d], &buf.keys[d * wc], m * sizeof(T));
+        ((std::memcpy(std::get<Is>(vdst) + pos[d], &std::get<Is>(buf.values)[d * wc], m * sizeof(Vs))), ...);
+        pos[d] += m;
+    };
+    for (size_t i = 0; i < len; i++) {
+        unsigned d = radix_digit(src[i], shift, mask);
+        size_t k = d * wc + fill[d];
+        buf.keys[k] = src[i];
+        ((std::get<Is>(buf.values)[k] = std::get<Is>(vsrc)[i]), ...);
+        if (++fill[d] == limit[d]) {
+            flush(d, fill[d]);
+            fill[d] = 0;
+            limit[d] = wc;
+        }
+    }
+    for (unsigned d = 0; d < 256; d++) {
+        if (fill[d])
+            flush(d, fill[d]);
+    }
+    if (stream)
+        stream_fence();
+}
+
+// stably sorts keys[0, n) and every values array along with them on the bits
+// [begin_bit, end_bit) of their order-preserving representation; a pass
+// where all keys share one digit is skipped, its histogram is all it costs
+template <class T, class ...Vs>
+void sort(T *keys, size_t n, int begin_bit, int end_bit, Vs *...values) {
+    auto vseq = std::index_sequence_for<Vs...>{};
+    if (n <= 1 || begin_bit >= end_bit) return;
+    size_t blocks = (n + block_size - 1) / block_size;
+    bool stream = n * sizeof(T) >= streaming_bytes;
+    std::vector<T> keys_tmp(n);
+    std::tuple<std::vector<Vs>...> values_tmp{std::vector<Vs>(n)...};
+    T *src = keys;
+    T *dst = keys_tmp.data();
+    std::tuple<Vs *...> vsrc{values...};
+    std::tuple<Vs *...> vdst = std::apply([] (auto &...v) {
+        return std::tuple<Vs *...>{v.data()...};
+    }, values_tmp);
+#ifdef CLIB_HOST_RADIX_SORT_TBB
+    tbb::enumerable_thread_specific<write_combining<T, Vs...>> scratch;
+#else
+    struct {
+        write_combining<T, Vs...> buf;
+        write_combining<T, Vs...> &local() {
+            return buf;
+        }
+    } scratch;
+#endif
+    // count[b * 256 + d] = keys of block b with digit d, then where they go
+    std::vector<size_t> count(blocks * 256);
+    for (int shift = begin_bit; shift < end_bit; shift += 8) {
+        unsigned mask = end_bit - shift >= 8 ? 0xffu : (1u << (end_bit - shift)) - 1;
+        for_each_block(blocks, [&] (size_t b) {
+            size_t begin = b * block_size;
+            histogram(src + begin, std::min(block_size, n - begin), shift, mask, &count[b * 256]);
+        });
+        bool trivial = false;
+        size_t total = 0;
+        for (int d = 0; d < 256; d++) {
+            size_t digit_total = total;
+            for (size_t b = 0; b < blocks; b++) {
+                size_t c = count[b * 256 + d];
+                count[b * 256 + d] = total;
+                total += c;
+            }
+            trivial = trivial || total - digit_total == n;
+        }
+        if (trivial)
+            continue;
+        for_each_block(blocks, [&] (size_t b) {
+            size_t begin = b * block_size;
+            auto block_of = [begin] (auto *...v) {
+                return std::tuple<Vs *...>{(v + begin)...};
+            };
+            scatter(scratch.local(), src + begin, std::min(block_size, n - begin), shift, mask, &count[b * 256], dst,
+                    stream, std::apply(block_of, vsrc), vdst, vseq);
+        });
+        std::swap(src, dst);
+        std::swap(vsrc, vdst);
+    }
+    if (src != keys) {
+        for_each_block(blocks, [&] (size_t b) {
+            size_t begin = b * block_size;
+            size_t len = std::min(block_size, n - begin);
+            std::copy(src + begin, src + begin + len, keys + begin);
+            std::apply([&] (auto *...from) {
+                std::apply([&] (auto *...to) {
+                    (std::copy(from + begin, from + begin + len, to + begin), ...);
+                }, std::tuple<Vs *...>{values...});
+            }, vsrc);
+        });
+    }
+}
+
+}
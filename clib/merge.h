@@ -0,0 +1,290 @@
+#pragma once
+
+#include <sycl/sycl.hpp>
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include "device_memory.h"
+
+template <int ipt, class H, class Comp>
+class KT_merge;
+template <int ipt, class H, class Comp>
+class KT_merge_sort;
+template <class Name>
+class KT_merge_partition;
+template <class Name>
+class KT_merge_tiles;
+template <int ipt, class H, class Comp>
+class KT_merge_sort_block;
+
+// elements every work-item merges sequentially, one tile is 256 * ipt
+// elements of output
+inline constexpr int merge_items_per_thread = 8;
+
+namespace _merge_details {
+
+// how a merge pass reads and writes: load(k) is element k of the input,
+// store(p, x) puts x at output position p
+template <class L, class S>
+struct merge_io {
+    L load;
+    S store;
+};
+
+template <class L, class S>
+merge_io(L, S) -> merge_io<L, S>;
+
+// the number of elements of a among the first d of the stable merge of a
+// and b, at(k) being a[k] for k < na and b[k - na] after: a binary search
+// along the d-th anti-diagonal of the merge matrix, ties taken from a
+template <class At, class Comp>
+size_t merge_path(At const &at, size_t na, size_t nb, size_t d, Comp comp) {
+    size_t lo = d > nb ? d - nb : 0;
+    size_t hi = std::min(d, na);
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (comp(at(na + d - 1 - mid), at(mid)))
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+// merges the up to ipt elements from position d on of the merge of the
+// runs a = loc[base, base + na) and b = loc[base + na, base + na + nb)
+// into x, returns how many
+template <int ipt, class T, class Loc, class Comp>
+int merge_strip(Loc const &loc, size_t base, size_t na, size_t nb, size_t d, T (&x)[ipt], Comp comp) {
+    auto at = [&] (size_t k) -> T {
+        return loc[base + k];
+    };
+    size_t i = merge_path(at, na, nb, d, comp);
+    size_t j = d - i;
+    int count = std::min<size_t>(ipt, na + nb - d);
+    for (int r = 0; r < count; r++) {
+        if (j >= nb || (i < na && !comp(at(na + j), at(i))))
+            x[r] = at(i++);
+        else
+            x[r] = at(na + j++);
+    }
+    return count;
+}
+
+// every output position p of [0, n) lies in a pair of runs starting at
+// p / span * span, the first run of up to run elements followed directly by
+// the second of up to span - run; a tile never straddles two pairs, so span
+// is a multiple of the tile or at least n. The first pass finds, for every
+// tile, where its output starts along the merge path of its pair, the second
+// stages each tile's slices of both runs in local memory and merges them
+template <int ipt, class Name, class M, class Bind, class Comp>
+void merge_runs(M &mem, size_t n, size_t span, size_t run, Bind bind, Comp comp) {
+    constexpr size_t tile = 256 * ipt;
+    size_t tiles = (n + tile - 1) / tile;
+    auto split = mem.template alloc<size_t>(tiles);
+    auto pair = [=] (size_t p) {
+        size_t base = p / span * span;
+        size_t na = std::min(run, n - base);
+        size_t nb = std::min(span, n - base) - na;
+        return std::tuple{base, na, nb};
+    };
+    mem.submit([&] (sycl::handler &cgh) {
+        auto io = bind(cgh);
+        auto s = M::write(cgh, split);
+        cgh.parallel_for<KT_merge_partition<Name>>(sycl::range<1>{tiles}, [=] (sycl::id<1> t) {
+            size_t p = t[0] * tile;
+            auto [base, na, nb] = pair(p);
+            s[t] = merge_path([&] (size_t k) { return io.load(base + k); }, na, nb, p - base, comp);
+        });
+    });
+    mem.submit([&] (sycl::handler &cgh) {
+        using T = decltype(bind(cgh).load(0));
+        sycl::local_accessor<T> loc{tile, cgh};
+        auto io = bind(cgh);
+        auto s = M::read(cgh, split);
+        cgh.parallel_for<KT_merge_tiles<Name>>(sycl::nd_range<1>{tiles * 256, 256}, [=] (sycl::nd_item<1> it) {
+            int ii = it.get_local_id(0);
+            int gi = it.get_group(0);
+            size_t p0 = gi * tile;
+            size_t p1 = std::min(p0 + tile, n);
+            auto [base, na, nb] = pair(p0);
+            size_t i0 = s[gi];
+            size_t i1 = p1 == std::min(base + span, n) ? na : s[gi + 1];
+            size_t j0 = p0 - base - i0;
+            size_t la = i1 - i0;
+            size_t len = p1 - p0;
+            for (size_t k = ii; k < len; k += 256) {
+                loc[k] = k < la ? io.load(base + i0 + k) : io.load(base + na + j0 + (k - la));
+            }
+            it.barrier(sycl::access::fence_space::local_space);
+            size_t d = std::min<size_t>(ii * ipt, len);
+            T x[ipt];
+            int count = merge_strip(loc, 0, la, len - la, d, x, comp);
+            it.barrier(sycl::access::fence_space::local_space);
+            for (int r = 0; r < count; r++) {
+                loc[d + r] = x[r];
+            }
+            it.barrier(sycl::access::fence_space::local_space);
+            for (size_t k = ii; k < len; k += 256) {
+                io.store(p0 + k, loc[k]);
+            }
+        });
+    });
+}
+
+// sorts every tile of buf in place: each work-item sorts its ipt elements
+// in registers, then runs of ipt, 2 ipt, ... are merged pairwise in local
+// memory, every work-item producing ipt elements of each merge
+template <int ipt, class M, class H, class Comp>
+void sort_tiles(M &mem, H &buf, Comp comp) {
+    using T = typename H::value_type;
+    constexpr size_t tile = 256 * ipt;
+    size_t n = buf.size();
+    size_t tiles = (n + tile - 1) / tile;
+    mem.submit([&] (sycl::handler &cgh) {
+        sycl::local_accessor<T> loc{tile, cgh};
+        auto a = M::read_write(cgh, buf);
+        cgh.parallel_for<KT_merge_sort_block<ipt, H, Comp>>(sycl::nd_range<1>{tiles * 256, 256}, [=] (sycl::nd_item<1> it) {
+            int ii = it.get_local_id(0);
+            int gi = it.get_group(0);
+            size_t p0 = gi * tile;
+            size_t len = std::min(tile, n - p0);
+            size_t d = std::min<size_t>(ii * ipt, len);
+            int count = std::min<size_t>(ipt, len - d);
+            T x[ipt];
+            for (int r = 0; r < count; r++) {
+                x[r] = a[p0 + d + r];
+                for (int k = r; k > 0 && comp(x[k], x[k - 1]); k--) {
+                    std::swap(x[k], x[k - 1]);
+                }
+            }
+            for (int r = 0; r < count; r++) {
+                loc[d + r] = x[r];
+            }
+            for (size_t w = ipt; w < len; w *= 2) {
+                it.barrier(sycl::access::fence_space::local_space);
+                size_t base = d / (2 * w) * (2 * w);
+                size_t na = std::min(w, len - base);
+                size_t nb = std::min(2 * w, len - base) - na;
+                if (d < len)
+                    merge_strip(loc, base, na, nb, d - base, x, comp);
+                it.barrier(sycl::access::fence_space::local_space);
+                for (int r = 0; r < count; r++) {
+                    loc[d + r] = x[r];
+                }
+            }
+            it.barrier(sycl::access::fence_space::local_space);
+            for (size_t k = ii; k < len; k += 256) {
+                a[p0 + k] = loc[k];
+            }
+        });
+    });
+}
+
+template <int ipt, class M, class HA, class HB, class HO, class Comp>
+void merge(M &mem, HA &a, HB &b, HO &out, Comp comp) {
+    size_t na = a.size();
+    size_t n = na + b.size();
+    if (n == 0) return;
+    merge_runs<ipt, KT_merge<ipt, HO, Comp>>(mem, n, n, na, [&] (sycl::handler &cgh) {
+        auto aa = M::read(cgh, a);
+        auto ab = M::read(cgh, b);
+        auto o = M::write(cgh, out);
+        return merge_io{[=] (size_t k) {
+            return k < na ? aa[k] : ab[k - na];
+        }, [=] (size_t p, typename HO::value_type const &x) {
+            o[p] = x;
+        }};
+    }, comp);
+}
+
+// sorted tiles, then rounds of merge_runs doubling the sorted run length,
+// ping-ponging between buf and a temporary
+template <int ipt, class M, class H, class Comp>
+void merge_sort(M &mem, H &buf, Comp comp) {
+    using T = typename H::value_type;
+    constexpr size_t tile = 256 * ipt;
+    size_t n = buf.size();
+    if (n <= 1) return;
+    sort_tiles<ipt>(mem, buf, comp);
+    if (n <= tile) return;
+    auto tmp = mem.template alloc<T>(n);
+    H *src = &buf, *dst = &tmp;
+    for (size_t w = tile; w < n; w *= 2) {
+        merge_runs<ipt, KT_merge_sort<ipt, H, Comp>>(mem, n, 2 * w, w, [&] (sycl::handler &cgh) {
+            auto a = M::read(cgh, *src);
+            auto o = M::write(cgh, *dst);
+            return merge_io{[=] (size_t k) {
+                return a[k];
+            }, [=] (size_t p, T const &x) {
+                o[p] = x;
+            }};
+        }, comp);
+        std::swap(src, dst);
+    }
+    if (src != &buf)
+        mem.copy(*src, buf);
+}
+
+}
+
+// merges the sorted a and b into out of a.size() + b.size() elements, stably
+// (of equivalent elements those of a come first) under the strict weak
+// ordering comp; merge-path partitioning gives every work-group an equal
+// share of the output whatever the distribution of the inputs
+template <int ipt = merge_items_per_thread, class T, class Comp = std::less<>>
+void merge(sycl::queue &q, sycl::buffer<T> &a, sycl::buffer<T> &b, sycl::buffer<T> &out, Comp comp = {}) {
+    buffer_memory mem{q};
+    _merge_details::merge<ipt>(mem, a, b, out, comp);
+}
+
+template <int ipt = merge_items_per_thread, class T, class Comp = std::less<>>
+sycl::event merge(sycl::queue &q, T const *a, size_t na, T const *b, size_t nb, T *out, Comp comp = {},
+                  std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<T> sa{const_cast<T *>(a), na};
+    usm_span<T> sb{const_cast<T *>(b), nb};
+    usm_span<T> o{out, na + nb};
+    _merge_details::merge<ipt>(mem, sa, sb, o, comp);
+    return mem.finish();
+}
+
+// stable comparison sort of any size in place, for orderings radix_sort
+// cannot express: O(n log n) work in log2(n / (256 * ipt)) merge passes
+// after every tile has been sorted in local memory
+template <int ipt = merge_items_per_thread, class T, class Comp = std::less<>>
+void merge_sort(sycl::queue &q, sycl::buffer<T> &buf, Comp comp = {}) {
+    buffer_memory mem{q};
+    _merge_details::merge_sort<ipt>(mem, buf, comp);
+}
+
+template <int ipt = merge_items_per_thread, class T, class Comp = std::less<>>
+sycl::event merge_sort(sycl::queue &q, T *data, size_t n, Comp comp = {},
+                       std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<T> s{data, n};
+    _merge_details::merge_sort<ipt>(mem, s, comp);
+    return mem.finish();
+}
+
+// bytes of temp_storage the USM merge of na + nb elements and the USM
+// merge_sort of n elements of T need
+template <int ipt = merge_items_per_thread, class T>
+size_t merge_temp_storage_bytes(sycl::queue &q, size_t na, size_t nb) {
+    usm_memory mem{q, usm_memory::measure_tag{}};
+    usm_span<T> sa{nullptr, na};
+    usm_span<T> sb{nullptr, nb};
+    usm_span<T> o{nullptr, na + nb};
+    _merge_details::merge<ipt>(mem, sa, sb, o, std::less<>{});
+    return mem.used_bytes();
+}
+
+template <int ipt = merge_items_per_thread, class T>
+size_t merge_sort_temp_storage_bytes(sycl::queue &q, size_t n) {
+    usm_memory mem{q, usm_memory::measure_tag{}};
+    usm_span<T> s{nullptr, n};
+    _merge_details::merge_sort<ipt>(mem, s, std::less<>{});
+    return mem.used_bytes();
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <sycl/sycl.hpp>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include "device_memory.h"
+#include "merge.h"
+#include "radix_sort.h"
+#include "radix_traits.h"
+
+struct multi_device_sort_options {
+    // keys per second every queue sorts, in the order of the queues, as
+    // measured once per set of queues by measure_sort_throughput; equal
+    // shares when empty or when they do not add up to a positive rate
+    std::vector<double> throughput;
+    // keys sampled from the sorted shards for every splitter
+    size_t oversampling = 64;
+    // how every shard is sorted, always by the kernels of its queue's device
+    // (see shard_options)
+    radix_sort_options sort;
+};
+
+namespace _multi_device_sort_details {
+
+// sort with the device backend: the host backend would spread every shard
+// over all cores, ignoring the NUMA partitioning of partition_cpu_devices
+inline radix_sort_options shard_options(radix_sort_options sort) {
+    sort.backend = radix_sort_backend::device;
+    return sort;
+}
+
+}
+
+// keys per second every queue radix sorts with the options sort (on the
+// device, as multi_device_sort does), timed on a copy of the first sample
+// keys after one untimed warm-up sort; two sorts per queue, so measure once
+// per set of queues and pass the result as multi_device_sort_options::throughput
+template <class T>
+std::vector<double> measure_sort_throughput(std::vector<sycl::queue> &queues, T const *keys, size_t n,
+                                            radix_sort_options const &sort = {}, size_t sample = 1 << 20) {
+    radix_sort_options shard = _multi_device_sort_details::shard_options(sort);
+    sample = std::max<size_t>(std::min(sample, n), 1);
+    std::vector<double> throughput;
+    for (auto &q: queues) {
+        double seconds = 0;
+        for (int round = 0; round < 2; round++) {
+            std::vector<T> copy(keys, keys + sample);
+            auto t0 = std::chrono::steady_clock::now();
+            {
+                sycl::buffer<T> buf{copy.data(), sample};
+                radix_sort(q, buf, shard);
+            }
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        }
+        throughput.push_back(sample / std::max(seconds, 1e-9));
+    }
+    return throughput;
+}
+
+// sorts keys[0, n) on the host across all queues, one per device (see
+// select_sycl_devices and partition_cpu_devices): shards weighted by the
+// throughput of their queue are radix sorted concurrently in device memory,
+// splitters taken from regular samples of the sorted shards cut every
+// shard into one bucket per queue, and every queue merges its bucket's runs
+// in device memory, all queues at once, before writing it back in place;
+// every queue needs its shard and two copies of its bucket of device memory
+template <class T>
+void multi_device_sort(std::vector<sycl::queue> &queues, T *keys, size_t n, multi_device_sort_options const &opts = {}) {
+    size_t p = queues.size();
+    if (n <= 1 || p == 0) return;
+    radix_sort_options shard = _multi_device_sort_details::shard_options(opts.sort);
+    if (p == 1) {
+        {
+            sycl::buffer<T> buf{keys, n};
+            radix_sort(queues[0], buf, shard);
+        }
+        return;
+    }
+    std::vector<double> weight = opts.throughput.size() == p ? opts.throughput : std::vector<double>(p, 1.0);
+    for (auto &w: weight) {
+        w = std::isfinite(w) ? std::max(w, 0.0) : 0.0;
+    }
+    double total = std::accumulate(weight.begin(), weight.end(), 0.0);
+    if (!(total > 0)) {
+        weight.assign(p, 1.0);
+        total = p;
+    }
+    // shard i is keys[cut[i], cut[i + 1])
+    std::vector<size_t> cut(p + 1, n);
+    double acc = 0;
+    for (size_t i = 0; i < p; i++) {
+        cut[i] = std::min<size_t>(n * (acc / total), n);
+        acc += weight[i];
+    }
+    // every queue sorts its shard through its own device copy and
+    // temp_storage, so no temporary's destructor waits before the other
+    // queues have their shards submitted
+    {
+        std::vector<T *> dev(p, nullptr);
+        std::vector<void *> temp(p, nullptr);
+        std::vector<sycl::event> done;
+        for (size_t i = 0; i < p; i++) {
+            size_t len = cut[i + 1] - cut[i];
+            if (len <= 1)
+                continue;
+            auto &q = queues[i];
+            size_t temp_bytes = radix_sort_temp_storage_bytes<radix_sort_engine::classic, radix_sort_items_per_thread, T>(q, len, shard);
+            dev[i] = sycl::malloc_device<T>(len, q);
+            temp[i] = sycl::malloc_device(std::max<size_t>(temp_bytes, 1), q);
+            radix_sort_options sort = shard;
+            sort.temp = temp_storage{temp[i], temp_bytes};
+            sycl::event up = q.memcpy(dev[i], keys + cut[i], len * sizeof(T));
+            sycl::event sorted = radix_sort(q, dev[i], len, {up}, sort);
+            done.push_back(q.memcpy(keys + cut[i], dev[i], len * sizeof(T), std::vector<sycl::event>{sorted}));
+        }
+        sycl::event::wait_and_throw(done);
+        for (size_t i = 0; i < p; i++) {
+            if (dev[i]) {
+                sycl::free(dev[i], queues[i]);
+                sycl::free(temp[i], queues[i]);
+            }
+        }
+    }
+    radix_less<T> less;
+    // every sample stands for stride keys, so the sample is distributed like
+    // the input and bucket j gets its queue's share of it
+    size_t stride = std::max<size_t>(n / (opts.oversampling * p), 1);
+    std::vector<T> samples;
+    for (size_t i = 0; i < p; i++) {
+        for (size_t k = cut[i] + stride / 2; k < cut[i + 1]; k += stride) {
+            samples.push_back(keys[k]);
+        }
+    }
+    std::sort(samples.begin(), samples.end(), less);
+    std::vector<T> splitters;
+    acc = 0;
+    for (size_t j = 0; j + 1 < p; j++) {
+        acc += weight[j];
+        splitters.push_back(samples[std::min<size_t>(samples.size() * (acc / total), samples.size() - 1)]);
+    }
+    // run[i][j] = where bucket j starts in shard i
+    std::vector<std::vector<size_t>> run(p, std::vector<size_t>(p + 1));
+    std::vector<size_t> bucket_begin(p + 1, 0);
+    for (size_t i = 0; i < p; i++) {
+        run[i][0] = cut[i];
+        run[i][p] = cut[i + 1];
+        for (size_t j = 1; j < p; j++) {
+            run[i][j] = std::lower_bound(keys + run[i][j - 1], keys + cut[i + 1], splitters[j - 1], less) - keys;
+        }
+        for (size_t j = 0; j < p; j++) {
+            bucket_begin[j + 1] += run[i][j + 1] - run[i][j];
+        }
+    }
+    std::partial_sum(bucket_begin.begin(), bucket_begin.end(), bucket_begin.begin());
+    // queue j merges the p runs of bucket j pairwise in device memory, all
+    // queues at once; the buckets overwrite keys only once every queue has
+    // read its runs
+    std::vector<T *> bucket(p, nullptr);
+    std::vector<T *> scratch(p, nullptr);
+    // bounds[j] = where the runs of bucket j start, and its end
+    std::vector<std::vector<size_t>> bounds(p, std::vector<size_t>{0});
+    std::vector<sycl::event> uploaded;
+    for (size_t j = 0; j < p; j++) {
+        size_t m = bucket_begin[j + 1] - bucket_begin[j];
+        if (m == 0)
+            continue;
+        auto &q = queues[j];
+        bucket[j] = sycl::malloc_device<T>(m, q);
+        scratch[j] = sycl::malloc_device<T>(m, q);
+        for (size_t i = 0; i < p; i++) {
+            size_t len = run[i][j + 1] - run[i][j];
+            if (len) {
+                uploaded.push_back(q.memcpy(bucket[j] + bounds[j].back(), keys + run[i][j], len * sizeof(T)));
+                bounds[j].push_back(bounds[j].back() + len);
+            }
+        }
+    }
+    sycl::event::wait_and_throw(uploaded);
+    std::vector<sycl::event> done;
+    for (size_t j = 0; j < p; j++) {
+        if (!bucket[j])
+            continue;
+        usm_memory mem{queues[j], std::vector<sycl::event>{}};
+        T *src = bucket[j];
+        T *dst = scratch[j];
+        auto &b = bounds[j];
+        while (b.size() > 2) {
+            std::vector<size_t> merged{0};
+            for (size_t k = 0; k + 1 < b.size(); k += 2) {
+                if (k + 2 < b.size()) {
+                    usm_span<T> ra{src + b[k], b[k + 1] - b[k]};
+                    usm_span<T> rb{src + b[k + 1], b[k + 2] - b[k + 1]};
+                    usm_span<T> out{dst + b[k], b[k + 2] - b[k]};
+                    _merge_details::merge<merge_items_per_thread>(mem, ra, rb, out, less);
+                    merged.push_back(b[k + 2]);
+                } else {
+                    usm_span<T> ra{src + b[k], b[k + 1] - b[k]};
+                    usm_span<T> out{dst + b[k], b[k + 1] - b[k]};
+                    mem.copy(ra, out);
+                    merged.push_back(b[k + 1]);
+                }
+            }
+            b = std::move(merged);
+            std::swap(src, dst);
+        }
+        mem.submit([&] (sycl::handler &cgh) {
+            cgh.memcpy(keys + bucket_begin[j], src, b.back() * sizeof(T));
+        });
+        done.push_back(mem.finish());
+    }
+    sycl::event::wait_and_throw(done);
+    for (size_t j = 0; j < p; j++) {
+        if (bucket[j]) {
+            sycl::free(bucket[j], queues[j]);
+            sycl::free(scratch[j], queues[j]);
+        }
+    }
+}
+
+template <class T>
+void multi_device_sort(std::vector<sycl::queue> &queues, std::vector<T> &keys, multi_device_sort_options const &opts = {}) {
+    multi_device_sort(queues, keys.data(), keys.size(), opts);
+}
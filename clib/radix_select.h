@@ -0,0 +1,441 @@
+#pragma once
+
+#include <sycl/sycl.hpp>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include "device_memory.h"
+#include "exclusive_scan.h"
+#include "radix_sort.h"
+#include "radix_traits.h"
+
+template <int ipt, class H>
+class KT_nth_element;
+template <int ipt, class H>
+class KT_nth_element_pivot;
+template <int ipt, class H>
+class KT_partial_sort;
+template <int ipt, class H>
+class KT_top_k;
+template <int ipt, class H, bool descending>
+class KT_radix_select_init;
+template <int ipt, class H, bool descending>
+class KT_radix_select_histogram;
+template <int ipt, class H, bool descending>
+class KT_radix_select_pick;
+template <class H, bool in_place>
+class KT_radix_select_keep;
+template <class Op>
+class KT_radix_select_split;
+
+namespace _radix_select_details {
+
+// the entries of the device-resident state of a selection of rank nth: the
+// element of rank nth has the bits prefix above bit shift, before elements
+// precede every element with those bits and equal ones (it included) share
+// them; the candidates of the last pass were scanned of them, and
+// nth_element keeps its swap count and pivot position after them
+enum : int {
+    state_prefix,
+    state_shift,
+    state_before,
+    state_equal,
+    state_scanned,
+    state_misplaced,
+    state_pivot,
+    state_pivot_at,
+    state_size,
+};
+
+// the bits of the order-preserving representation of x above bit shift
+template <class T>
+uint64_t high_bits(T const &x, int shift) {
+    return shift >= radix_bits<T> ? 0 : (uint64_t)(radix_traits<T>::to_bits(x) >> shift);
+}
+
+// the running count of the kept candidates up to a key, and that key: an
+// inclusive scan hands every key its own destination, so the compaction
+// can run in place
+template <class T>
+struct counted_key {
+    unsigned count;
+    T key;
+};
+
+struct counted_key_op {
+    template <class T>
+    counted_key<T> operator()(counted_key<T> const &a, counted_key<T> const &b) const {
+        return {a.count + b.count, b.key};
+    }
+};
+
+// tiles of keys with their counts fit the local memory of a scan at half
+// its usual items per thread
+inline constexpr int keep_items_per_thread = scan_items_per_thread / 2;
+
+// moves the candidates of src sharing the prefix just picked to the front
+// of dst, which may be src: a look-back tile has read all its keys before
+// it publishes, and every key lands at or before its own position, so only
+// keys already read are overwritten; grid is the size of the full input,
+// the scanned count on the device bounds the keys read
+template <bool in_place, class M, class H, class S>
+void keep_candidates(M &mem, H &src, H &dst, S &state, size_t grid, int shift) {
+    using T = typename H::value_type;
+    _exclusive_scan_details::scan_lookback<true, keep_items_per_thread, KT_radix_select_keep<H, in_place>>(mem, grid, [&] (sycl::handler &cgh) {
+        auto st = M::read(cgh, state);
+        auto io = [=] (auto a, auto o) {
+            // nothing is read once the rank is down to one key or the
+            // selection stopped at a wider shift
+            auto live = [=] (size_t i) {
+                return st[state_shift] == (uint64_t)shift && st[state_equal] > 1 && i < st[state_scanned];
+            };
+            return _exclusive_scan_details::scan_io{[=] (size_t i) {
+                if (!live(i))
+                    return counted_key<T>{0, T{}};
+                T x = a[i];
+                return counted_key<T>{high_bits(x, shift) == st[state_prefix], x};
+            }, [=] (size_t i, counted_key<T> const &v) {
+                if (live(i) && high_bits(v.key, shift) == st[state_prefix])
+                    o[v.count - 1] = v.key;
+            }};
+        };
+        if constexpr (in_place) {
+            auto a = M::read_write(cgh, dst);
+            return io(a, a);
+        } else {
+            return io(M::read(cgh, src), M::write(cgh, dst));
+        }
+    }, false, counted_key<T>{0, T{}}, counted_key_op{});
+}
+
+// finds the element of rank nth in ascending (or descending) order of data
+// most significant digit first, entirely on the device: every pass counts
+// the digits of the candidates, then a single work-group picks the bucket
+// holding rank nth and appends it to the prefix, and the keys of that
+// bucket are compacted to the front of cand (data.size() keys); the count
+// of candidates stays on the device, so every pass launches the full grid
+// and work past it returns at once, as does all of a pass after the rank is
+// down to one key
+template <int ipt, bool descending, class M, class H>
+auto select(M &mem, H &data, H &cand, size_t nth) {
+    using T = typename H::value_type;
+    size_t n = data.size();
+    size_t tiles = (n + 256 * ipt - 1) / (256 * ipt);
+    size_t groups = std::min<size_t>(tiles, mem.queue().get_device().template get_info<sycl::info::device::max_compute_units>() * 4);
+    auto state = mem.template alloc<uint64_t>(state_size);
+    auto hist = mem.template alloc<unsigned>(256);
+    mem.submit([&] (sycl::handler &cgh) {
+        auto st = M::write(cgh, state);
+        cgh.parallel_for<KT_radix_select_init<ipt, H, descending>>(sycl::range<1>{1}, [=] (sycl::id<1>) {
+            st[state_prefix] = 0;
+            st[state_shift] = radix_bits<T>;
+            st[state_before] = 0;
+            st[state_equal] = n;
+            st[state_scanned] = n;
+        });
+    });
+    for (int shift = radix_bits<T> - 8; shift >= 0; shift -= 8) {
+        H &src = shift == radix_bits<T> - 8 ? data : cand;
+        mem.fill(hist, 0u);
+        mem.submit([&] (sycl::handler &cgh) {
+            sycl::local_accessor<unsigned> count{256, cgh};
+            auto a = M::read(cgh, src);
+            auto st = M::read(cgh, state);
+            auto h = M::read_write(cgh, hist);
+            cgh.parallel_for<KT_radix_select_histogram<ipt, H, descending>>(sycl::nd_range<1>{groups * 256, 256}, [=] (sycl::nd_item<1> it) {
+                size_t m = st[state_equal];
+                if (m <= 1)
+                    return;
+                int ii = it.get_local_id(0);
+                int gi = it.get_group(0);
+                size_t live = (m + 256 * ipt - 1) / (256 * ipt);
+                count[ii] = 0;
+                it.barrier(sycl::access::fence_space::local_space);
+                for (size_t t = gi; t < live; t += groups) {
+                    for (int r = 0; r < ipt; r++) {
+                        size_t i = t * 256 * ipt + r * 256 + ii;
+                        if (i < m)
+                            atomic_ref(count[radix_digit(a[i], shift)]).fetch_add(1u);
+                    }
+                }
+                it.barrier(sycl::access::fence_space::local_space);
+                if (unsigned c = count[ii])
+                    atomic_ref<sycl::memory_order_relaxed, sycl::memory_scope_device>(h[ii]).fetch_add(c);
+            });
+        });
+        mem.submit([&] (sycl::handler &cgh) {
+            auto h = M::read(cgh, hist);
+            auto st = M::read_write(cgh, state);
+            cgh.parallel_for<KT_radix_select_pick<ipt, H, descending>>(sycl::nd_range<1>{256, 256}, [=] (sycl::nd_item<1> it) {
+                uint64_t m = st[state_equal];
+                if (m <= 1)
+                    return;
+                int ii = it.get_local_id(0);
+                unsigned b = descending ? 255 - ii : ii;
+                uint64_t c = h[b];
+                uint64_t s = sycl::exclusive_scan_over_group(it.get_group(), c, std::plus<>{});
+                uint64_t prefix = st[state_prefix];
+                uint64_t before = st[state_before];
+                // every work-item has read the state before one writes it
+                it.barrier(sycl::access::fence_space::global_space);
+                if (s <= nth - before && nth - before < s + c) {
+                    st[state_prefix] = prefix << 8 | b;
+                    st[state_shift] = shift;
+                    st[state_before] = before + s;
+                    st[state_equal] = c;
+                    st[state_scanned] = m;
+                }
+            });
+        });
+        // the last pass leaves no digit to count
+        if (shift == 0)
+            break;
+        if (&src == &data)
+            keep_candidates<false>(mem, data, cand, state, n, shift);
+        else
+            keep_candidates<true>(mem, cand, cand, state, n, shift);
+    }
+    return state;
+}
+
+struct split_count {
+    size_t less;
+    size_t equal;
+
+    split_count operator+(split_count const &o) const {
+        return {less + o.less, equal + o.equal};
+    }
+};
+
+// stably moves every element of data to its place around the selected one
+// of state (see select): those before it first, the equal ones next, the
+// rest last; store(pos, x) puts x at position pos
+template <int ipt, bool descending, class Op, class M, class H, class S, class BindStore>
+void split(M &mem, H &data, S &state, BindStore bind_store) {
+    using T = typename H::value_type;
+    _exclusive_scan_details::scan_lookback<false, ipt, KT_radix_select_split<Op>>(mem, data.size(), [&] (sycl::handler &cgh) {
+        auto a = M::read(cgh, data);
+        auto st = M::read(cgh, state);
+        auto store = bind_store(cgh);
+        auto classify = [=] (T const &x) {
+            uint64_t xb = high_bits(x, st[state_shift]);
+            uint64_t pb = st[state_prefix];
+            return split_count{descending ? xb > pb : xb < pb, xb == pb};
+        };
+        return _exclusive_scan_details::scan_io{[=] (size_t i) {
+            return classify(a[i]);
+        }, [=] (size_t i, split_count s) {
+            size_t before = st[state_before];
+            size_t equal = st[state_equal];
+            split_count c = classify(a[i]);
+            if (c.less)
+                store(s.less, a[i]);
+            else if (c.equal)
+                store(before + s.equal, a[i]);
+            else
+                store(before + equal + (i - s.less - s.equal), a[i]);
+        }};
+    }, true, split_count{0, 0}, std::plus<>{});
+}
+
+// like std::nth_element, swapping only the elements on the wrong side of
+// rank nth: those not among the nth + 1 smallest in front (ties broken by
+// position) pair with the ones that are behind it, the r-th of the first
+// counting from the front with the r-th of the second counting from the
+// back, so each finds its partner from its own scan prefix; a last swap
+// puts the selected element itself at nth
+template <int ipt, class M, class H>
+void nth_element(M &mem, H &data, size_t nth) {
+    using T = typename H::value_type;
+    size_t n = data.size();
+    if (nth >= n) return;
+    auto cand = mem.template alloc<T>(n);
+    auto state = select<ipt, false>(mem, data, cand, nth);
+    // at most this many of each side are misplaced; positions are unsigned
+    // like the digit counts
+    size_t pairs = std::min(nth + 1, n - nth - 1);
+    auto pos = mem.template alloc<unsigned>(std::max<size_t>(pairs * 2, 1));
+    _exclusive_scan_details::scan_lookback<false, scan_items_per_thread, KT_nth_element<ipt, H>>(mem, n, [&] (sycl::handler &cgh) {
+        auto a = M::read(cgh, data);
+        auto st = M::read_write(cgh, state);
+        auto p = M::write(cgh, pos);
+        auto classify = [=] (T const &x) {
+            uint64_t xb = high_bits(x, st[state_shift]);
+            uint64_t pb = st[state_prefix];
+            return split_count{xb < pb, xb == pb};
+        };
+        return _exclusive_scan_details::scan_io{[=] (size_t i) {
+            return classify(a[i]);
+        }, [=] (size_t i, split_count s) {
+            size_t before = st[state_before];
+            split_count c = classify(a[i]);
+            // the equal elements up to the selected one are low as well
+            size_t low_before = s.less + std::min<size_t>(s.equal, nth + 1 - before);
+            bool low = c.less || (c.equal && s.equal < nth + 1 - before);
+            if (i <= nth && !low)
+                p[i - low_before] = i;
+            if (i > nth && low)
+                p[pairs + nth - low_before] = i;
+            if (i == nth)
+                st[state_misplaced] = nth + 1 - low_before - low;
+            if (c.equal && s.equal == nth - before)
+                st[state_pivot] = st[state_pivot_at] = i;
+        }};
+    }, true, split_count{0, 0}, std::plus<>{});
+    mem.submit([&] (sycl::handler &cgh) {
+        auto a = M::read_write(cgh, data);
+        auto st = M::read_write(cgh, state);
+        auto p = M::read(cgh, pos);
+        cgh.parallel_for<KT_nth_element<ipt, H>>(sycl::range<1>{std::max<size_t>(pairs, 1)}, [=] (sycl::id<1> r) {
+            if (r[0] >= st[state_misplaced])
+                return;
+            size_t j = p[r], i = p[pairs + r[0]];
+            std::swap(a[j], a[i]);
+            if (i == st[state_pivot])
+                st[state_pivot_at] = j;
+        });
+    });
+    mem.submit([&] (sycl::handler &cgh) {
+        auto a = M::read_write(cgh, data);
+        auto st = M::read(cgh, state);
+        cgh.parallel_for<KT_nth_element_pivot<ipt, H>>(sycl::range<1>{1}, [=] (sycl::id<1>) {
+            size_t at = st[state_pivot_at];
+            if (at != nth)
+                std::swap(a[at], a[nth]);
+        });
+    });
+}
+
+// the k smallest go to a separate head, which is sorted and put back in
+// front of the rest, kept in the candidates of the selection meanwhile:
+// n + k temporaries with those of the sort of the head
+template <int ipt, class M, class H>
+void partial_sort(M &mem, H &data, size_t k) {
+    using T = typename H::value_type;
+    size_t n = data.size();
+    k = std::min(k, n);
+    if (k == 0) return;
+    if (k == n) {
+        _radix_sort_details::radix_sort_by_key<radix_sort_engine::classic, ipt>(mem, radix_sort_options{}, data);
+        return;
+    }
+    auto cand = mem.template alloc<T>(n);
+    auto state = select<ipt, false>(mem, data, cand, k - 1);
+    auto head = mem.template alloc<T>(k);
+    split<scan_items_per_thread, false, KT_partial_sort<ipt, H>>(mem, data, state, [&] (sycl::handler &cgh) {
+        auto h = M::write(cgh, head);
+        auto t = M::write(cgh, cand);
+        return [=] (size_t pos, T const &x) {
+            if (pos < k)
+                h[pos] = x;
+            else
+                t[pos] = x;
+        };
+    });
+    _radix_sort_details::radix_sort_by_key<radix_sort_engine::classic, ipt>(mem, radix_sort_options{}, head);
+    mem.submit([&] (sycl::handler &cgh) {
+        auto h = M::read(cgh, head);
+        auto t = M::read(cgh, cand);
+        auto a = M::write(cgh, data);
+        cgh.parallel_for<KT_partial_sort<ipt, H>>(sycl::range<1>{n}, [=] (sycl::id<1> i) {
+            a[i] = i[0] < k ? h[i] : t[i];
+        });
+    });
+}
+
+// the out.size() largest, sorted ascending by radix_sort and then reversed
+template <int ipt, class M, class H>
+void top_k(M &mem, H &data, H &out) {
+    using T = typename H::value_type;
+    size_t k = std::min(out.size(), data.size());
+    if (k == 0) return;
+    auto cand = mem.template alloc<T>(data.size());
+    auto state = select<ipt, true>(mem, data, cand, k - 1);
+    split<scan_items_per_thread, true, KT_top_k<ipt, H>>(mem, data, state, [&] (sycl::handler &cgh) {
+        auto o = M::write(cgh, out);
+        return [=] (size_t pos, T const &x) {
+            if (pos < k)
+                o[pos] = x;
+        };
+    });
+    _radix_sort_details::radix_sort_by_key<radix_sort_engine::classic, ipt>(mem, radix_sort_options{}, out);
+    mem.submit([&] (sycl::handler &cgh) {
+        auto o = M::read_write(cgh, out);
+        cgh.parallel_for<KT_top_k<ipt, H>>(sycl::range<1>{k / 2}, [=] (sycl::id<1> i) {
+            std::swap(o[i], o[k - 1 - i[0]]);
+        });
+    });
+}
+
+}
+
+// the selections below read all keys once, then per 8-bit digit only the
+// keys left in the bucket of the rank, instead of every pass of a full sort,
+// and never wait on the host; keys order as in radix_sort (see
+// radix_traits.h) and their counts must fit in unsigned
+
+// rearranges buf like std::nth_element: buf[nth] becomes the element a sort
+// would put there, with every element before it not greater and every one
+// after not less
+template <int ipt = radix_sort_items_per_thread, class T>
+void nth_element(sycl::queue &q, sycl::buffer<T> &buf, size_t nth) {
+    buffer_memory mem{q};
+    _radix_select_details::nth_element<ipt>(mem, buf, nth);
+}
+
+// sorts the k smallest elements of buf into buf[0, k), the rest follow in
+// their original order
+template <int ipt = radix_sort_items_per_thread, class T>
+void partial_sort(sycl::queue &q, sycl::buffer<T> &buf, size_t k) {
+    buffer_memory mem{q};
+    _radix_select_details::partial_sort<ipt>(mem, buf, k);
+}
+
+// the out.size() <= in.size() largest elements of in, largest first; in is
+// left untouched
+template <int ipt = radix_sort_items_per_thread, class T>
+void top_k(sycl::queue &q, sycl::buffer<T> &in, sycl::buffer<T> &out) {
+    buffer_memory mem{q};
+    _radix_select_details::top_k<ipt>(mem, in, out);
+}
+
+template <int ipt = radix_sort_items_per_thread, class T>
+sycl::event nth_element(sycl::queue &q, T *data, size_t n, size_t nth,
+                        std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<T> s{data, n};
+    _radix_select_details::nth_element<ipt>(mem, s, nth);
+    return mem.finish();
+}
+
+template <int ipt = radix_sort_items_per_thread, class T>
+sycl::event partial_sort(sycl::queue &q, T *data, size_t n, size_t k,
+                         std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<T> s{data, n};
+    _radix_select_details::partial_sort<ipt>(mem, s, k);
+    return mem.finish();
+}
+
+template <int ipt = radix_sort_items_per_thread, class T>
+sycl::event top_k(sycl::queue &q, T const *in, size_t n, T *out, size_t k,
+                  std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<T> s{const_cast<T *>(in), n};
+    usm_span<T> o{out, k};
+    _radix_select_details::top_k<ipt>(mem, s, o);
+    return mem.finish();
+}
+
+// bytes of temp_storage any of the USM selections of up to k of n elements
+// of T needs
+template <int ipt = radix_sort_items_per_thread, class T>
+size_t radix_select_temp_storage_bytes(sycl::queue &q, size_t n, size_t k) {
+    usm_memory mem{q, usm_memory::measure_tag{}};
+    usm_span<T> s{nullptr, n};
+    _radix_select_details::partial_sort<ipt>(mem, s, k);
+    size_t bytes = mem.used_bytes();
+    usm_memory mem_nth{q, usm_memory::measure_tag{}};
+    _radix_select_details::nth_element<ipt>(mem_nth, s, n / 2);
+    return std::max(bytes, mem_nth.used_bytes());
+}
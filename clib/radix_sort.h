@@ -1,10 +1,38 @@
 #pragma once
 
 #include <sycl/sycl.hpp>
+#include <tuple>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <limits>
+#include <optional>
+#include <type_traits>
+#include <algorithm>
+#include <stdexcept>
+#include "device_memory.h"
 #include "exclusive_scan.h"
+#include "radix_traits.h"
+#include "host_radix_sort.h"
 
+// DPC++ can pin a kernel's sub-group size, other implementations take the
+// device's only one
+#if defined(__INTEL_LLVM_COMPILER) || defined(__SYCL_COMPILER_VERSION)
+#define CLIB_REQD_SUB_GROUP_SIZE 1
+#endif
+
+template <int ipt, int sg, bool reorder, class H, class ...Vs>
 class KT_radix_sort_histogram;
+template <int ipt, int sg, bool reorder, class H, class ...Vs>
 class KT_radix_sort_scatter;
+template <int ipt, class H, class ...Vs>
+class KT_radix_sort_digit_histogram;
+template <int ipt, int sg, bool reorder, class H, class ...Vs>
+class KT_radix_sort_onesweep_scatter;
+template <int sg, class H, class ...Vs>
+class KT_radix_sort_small;
+template <class H>
+class KT_radix_argsort_iota;
 
 template <
     sycl::memory_order memord = sycl::memory_order_relaxed,
@@ -24,63 +52,945 @@ void unlock(T &t) {
     atomic_ref<sycl::memory_order_acq_rel>(t).store(0);
 }
 
-inline void radix_sort(sycl::queue &q, sycl::buffer<unsigned> &buf) {
-    sycl::buffer<unsigned> buf_next{buf.size()};
-    sycl::buffer<unsigned> hist_group{buf.size()};
-    for (int bit = 0; bit < 4; bit++) {
-        q.submit([&] (sycl::handler &cgh) {
-            sycl::local_accessor<unsigned> count{256, cgh};
-            sycl::accessor hist{hist_group, cgh, sycl::write_only, sycl::no_init};
-            sycl::accessor a{buf, cgh, sycl::read_only};
-            cgh.parallel_for<KT_radix_sort_histogram>(sycl::nd_range<1>{buf.size(), 256}, [=] (sycl::nd_item<1> it) {
+namespace _radix_sort_details {
+
+template <class M, class ...Bufs, size_t ...Is>
+auto make_accessors([[maybe_unused]] sycl::handler &cgh, [[maybe_unused]] std::tuple<Bufs &...> bufs, std::index_sequence<Is...>) {
+    return std::make_tuple(M::read(cgh, std::get<Is>(bufs))...);
+}
+
+template <class M, class ...Bufs, size_t ...Is>
+auto make_accessors_no_init([[maybe_unused]] sycl::handler &cgh, [[maybe_unused]] std::tuple<Bufs &...> bufs, std::index_sequence<Is...>) {
+    return std::make_tuple(M::write(cgh, std::get<Is>(bufs))...);
+}
+
+template <class M, class ...Bufs, size_t ...Is>
+auto make_accessors_read_write([[maybe_unused]] sycl::handler &cgh, [[maybe_unused]] std::tuple<Bufs &...> bufs, std::index_sequence<Is...>) {
+    return std::make_tuple(M::read_write(cgh, std::get<Is>(bufs))...);
+}
+
+template <class ...Ins, class ...Outs, size_t ...Is>
+void scatter_values([[maybe_unused]] std::tuple<Ins...> const &vin, [[maybe_unused]] std::tuple<Outs...> const &vout,
+                    [[maybe_unused]] size_t i, [[maybe_unused]] size_t index, std::index_sequence<Is...>) {
+    ((std::get<Is>(vout)[index] = std::get<Is>(vin)[i]), ...);
+}
+
+template <class ...Bufs, size_t ...Is>
+void swap_buffers([[maybe_unused]] std::tuple<Bufs &...> a, [[maybe_unused]] std::tuple<Bufs &...> b, std::index_sequence<Is...>) {
+    (std::swap(std::get<Is>(a), std::get<Is>(b)), ...);
+}
+
+}
+
+enum class radix_sort_engine {
+    // per pass: histogram, exclusive_scan of the histogram, scatter
+    classic,
+    // one upfront histogram of every digit, then one scatter per pass that
+    // finds its global offsets by decoupled look-back over preceding tiles;
+    // inputs of 2^30 keys or more fall back to classic
+    onesweep,
+};
+
+namespace _radix_sort_details {
+
+inline unsigned popcount(unsigned mask) {
+#if defined(__GNUC__) && defined(__OPENSYCL__)
+    return __builtin_popcount(mask);
+#else
+    return sycl::popcount(mask);
+#endif
+}
+
+// rank of the ii-th key among the keys of its group having the same digit,
+// given the per-digit bitmasks of the group (9 words per digit, 8 used)
+template <class Bits>
+int local_rank(Bits const &bits, unsigned key, int ii) {
+    int popcorns = 0;
+    for (int k = 0; k <= (ii >> 5); k++) {
+        unsigned mask = bits[key * 9 + k];
+        if (ii < (k + 1) * 32)
+            mask &= (1u << (ii & 31)) - 1u;
+        popcorns += popcount(mask);
+    }
+    return popcorns;
+}
+
+// ranks one round of 256 keys of a tile: returns count[key] plus the rank of
+// the key within the round, then advances count by the digits of the round,
+// so calling it for every round of a tile in order yields stable positions
+template <class Bits, class Count>
+unsigned round_rank(sycl::nd_item<1> const &it, Bits const &bits, Count const &count, unsigned key, bool valid) {
+    int ii = it.get_local_id(0);
+    for (int k = 0; k < 8; k++) {
+        bits[ii * 9 + k] = 0u;
+    }
+    it.barrier(sycl::access::fence_space::local_space);
+    if (valid)
+        atomic_ref(bits[key * 9 + (ii >> 5)]).fetch_or(1u << (ii & 31));
+    it.barrier(sycl::access::fence_space::local_space);
+    unsigned index = valid ? count[key] + local_rank(bits, key, ii) : 0u;
+    it.barrier(sycl::access::fence_space::local_space);
+    unsigned total = 0;
+    for (int k = 0; k < 8; k++) {
+        total += popcount(bits[ii * 9 + k]);
+    }
+    count[ii] += total;
+    return index;
+}
+
+// bit l set for the lanes l of the sub-group whose pred holds, the
+// sub-group must have at most 32 lanes
+inline unsigned ballot(sycl::sub_group const &sg, bool pred) {
+#if defined(SYCL_EXT_ONEAPI_SUB_GROUP_MASK)
+    unsigned mask = 0;
+    sycl::ext::oneapi::group_ballot(sg, pred).extract_bits(mask);
+    return mask;
+#else
+    return sycl::reduce_over_group(sg, pred ? 1u << sg.get_local_linear_id() : 0u, sycl::bit_or<unsigned>{});
+#endif
+}
+
+// round_rank without the bitmask table: the lanes holding the same digit
+// are matched by 8 ballots over the digit bits, which ranks a key within
+// its sub-group, and sg_count (256 / sg rows of 256 digits) turns the
+// per-sub-group digit counts into offsets across sub-groups; every
+// work-item does the same constant work, and the kernel must be pinned to
+// sub-groups of sg lanes (see parallel_for_ranked)
+template <int sg_size, class SgCount, class Count>
+unsigned ballot_rank(sycl::nd_item<1> const &it, SgCount const &sg_count, Count const &count, unsigned key, bool valid) {
+    int ii = it.get_local_id(0);
+    auto sg = it.get_sub_group();
+    unsigned lane = sg.get_local_linear_id();
+    unsigned sgi = sg.get_group_linear_id();
+    constexpr unsigned rows = 256 / sg_size;
+    for (unsigned s = 0; s < rows; s++) {
+        sg_count[s * 256 + ii] = 0;
+    }
+    unsigned peers = ballot(sg, valid);
+    for (int b = 0; b < 8; b++) {
+        bool bit = key >> b & 1;
+        unsigned m = ballot(sg, bit);
+        peers &= bit ? m : ~m;
+    }
+    unsigned rank = popcount(peers & ((1u << lane) - 1u));
+    it.barrier(sycl::access::fence_space::local_space);
+    if (valid && rank == 0)
+        sg_count[sgi * 256 + key] = popcount(peers);
+    it.barrier(sycl::access::fence_space::local_space);
+    unsigned total = 0;
+    for (unsigned s = 0; s < rows; s++) {
+        unsigned c = sg_count[s * 256 + ii];
+        sg_count[s * 256 + ii] = total;
+        total += c;
+    }
+    it.barrier(sycl::access::fence_space::local_space);
+    unsigned index = valid ? count[key] + sg_count[sgi * 256 + key] + rank : 0u;
+    it.barrier(sycl::access::fence_space::local_space);
+    count[ii] += total;
+    return index;
+}
+
+// the ranking of the scatter kernels is chosen by sg: 0 is round_rank with
+// its 9 KiB bitmask table, 16 or 32 is ballot_rank on sub-groups pinned to
+// that size with 256 / sg rows of 16-bit digit counts (8 or 4 KiB)
+template <int sg>
+using rank_scratch = std::conditional_t<sg != 0, uint16_t, unsigned>;
+
+template <int sg>
+inline constexpr size_t rank_scratch_size = sg ? 256 / sg * 256 : 256 * 9;
+
+inline size_t rank_scratch_bytes(int sg) {
+    return sg == 32 ? rank_scratch_size<32> * sizeof(rank_scratch<32>)
+         : sg == 16 ? rank_scratch_size<16> * sizeof(rank_scratch<16>)
+         : rank_scratch_size<0> * sizeof(rank_scratch<0>);
+}
+
+template <int sg, class Scratch, class Count>
+unsigned rank_keys(sycl::nd_item<1> const &it, Scratch const &scratch, Count const &count, unsigned key, bool valid) {
+    if constexpr (sg != 0)
+        return ballot_rank<sg>(it, scratch, count, key, valid);
+    else
+        return round_rank(it, scratch, count, key, valid);
+}
+
+// cgh.parallel_for of a kernel ranking with rank_keys<sg>: ballot_rank's
+// table is sized for sub-groups of exactly sg lanes, so the kernel is
+// pinned to them
+template <class Name, int sg, class Body>
+void parallel_for_ranked(sycl::handler &cgh, sycl::nd_range<1> range, Body body) {
+#ifdef CLIB_REQD_SUB_GROUP_SIZE
+    if constexpr (sg != 0) {
+        cgh.parallel_for<Name>(range, [=] (sycl::nd_item<1> it) [[sycl::reqd_sub_group_size(sg)]] {
+            body(it);
+        });
+        return;
+    }
+#endif
+    cgh.parallel_for<Name>(range, body);
+}
+
+// one stable digit pass over len keys done by a single work-group of 256:
+// key_of(j) is the digit of the j-th key, move(j, index) moves the j-th key
+// and its payloads to index, the destination must not alias the source;
+// bits is the scratch of rank_keys<sg>; with skip_trivial a pass where all
+// keys share one digit moves nothing, returns whether the keys were moved
+template <int sg = 0, class Bits, class Count, class KeyOf, class Move>
+bool group_radix_pass(sycl::nd_item<1> const &it, Bits const &bits, Count const &count, size_t len, KeyOf key_of, Move move,
+                      bool skip_trivial = false) {
+    int ii = it.get_local_id(0);
+    count[ii] = 0;
+    it.barrier(sycl::access::fence_space::local_space);
+    for (size_t j = ii; j < len; j += 256) {
+        atomic_ref(count[key_of(j)]).fetch_add(1u);
+    }
+    it.barrier(sycl::access::fence_space::local_space);
+    if (skip_trivial && sycl::any_of_group(it.get_group(), count[ii] == len))
+        return false;
+    count[ii] = sycl::exclusive_scan_over_group(it.get_group(), (unsigned)count[ii], std::plus<>{});
+    for (size_t j0 = 0; j0 < len; j0 += 256) {
+        size_t j = j0 + ii;
+        bool valid = j < len;
+        unsigned key = valid ? key_of(j) : 0u;
+        unsigned index = rank_keys<sg>(it, bits, count, key, valid);
+        if (valid)
+            move(j, index);
+    }
+    it.barrier(sycl::access::fence_space::global_and_local);
+    return true;
+}
+
+// the second half of a coalesced scatter: the keys of a tile were staged in
+// tile_keys at their position within the tile ordered by digit, with their
+// index in the tile in tile_src, digit d's run starting at local_base[d];
+// each run is written to global_base[d] onwards, consecutive work-items to
+// consecutive addresses, the payloads gathered from within the tile
+template <class Keys, class Src, class Base, class Out, class ...Ins, class ...Outs, size_t ...Is>
+void write_tile_runs(sycl::nd_item<1> const &it, Keys const &tile_keys, Src const &tile_src,
+                     Base const &local_base, Base const &global_base, size_t len, size_t tile_base,
+                     int shift, unsigned mask, Out const &aout,
+                     std::tuple<Ins...> const &vin, std::tuple<Outs...> const &vout, std::index_sequence<Is...> vseq) {
+    it.barrier(sycl::access::fence_space::local_space);
+    for (size_t j = it.get_local_id(0); j < len; j += 256) {
+        auto key = tile_keys[j];
+        unsigned d = radix_digit(key, shift, mask);
+        size_t index = global_base[d] + (j - local_base[d]);
+        aout[index] = key;
+        scatter_values(vin, vout, tile_base + tile_src[j], index, vseq);
+    }
+}
+
+// only the last tile can be partial: keys past n are neither counted nor
+// ranked, full tiles skip the bound checks so aligned sizes pay nothing
+template <int ipt>
+bool tile_is_full(size_t ti, size_t n) {
+    return (ti + 1) * 256 * ipt <= n;
+}
+
+inline unsigned digit_mask(int shift, int end_bit) {
+    return end_bit - shift >= 8 ? 0xffu : (1u << (end_bit - shift)) - 1u;
+}
+
+// the tile histograms keep this many copies of their 256 counters, padded
+// to 257 apart so they sit on different banks; sub-group s counts into copy
+// s % histogram_copies, and a skewed input no longer serializes the atomics
+// of the whole work-group on one counter
+inline constexpr int histogram_copies = 4;
+inline constexpr int histogram_stride = 257;
+
+// counts key into count[base, base + 256) once the runs of equal keys on neighbouring
+// lanes of the sub-group are merged into one atomic add by the last lane of
+// the run; every work-item must call it, keys >= 256 are not counted
+template <class Count>
+void count_digit(sycl::nd_item<1> const &it, Count const &count, size_t base, unsigned key) {
+    auto sg = it.get_sub_group();
+    unsigned lane = sg.get_local_linear_id();
+    unsigned last = sg.get_local_range()[0] - 1;
+    unsigned prev = sycl::shift_group_right(sg, key, 1);
+    unsigned next = sycl::shift_group_left(sg, key, 1);
+    bool head = lane == 0 || prev != key;
+    bool tail = lane == last || next != key;
+    unsigned start = sycl::inclusive_scan_over_group(sg, head ? lane : 0u, sycl::maximum<unsigned>{});
+    if (tail && key < 256)
+        atomic_ref(count[base + key]).fetch_add(lane - start + 1);
+}
+
+// the counter copy of the calling work-item's sub-group among copies
+inline size_t histogram_copy(sycl::nd_item<1> const &it, int copies = histogram_copies) {
+    return it.get_sub_group().get_group_linear_id() % copies * histogram_stride;
+}
+
+// counts the digits of every pass in one read of the first n keys: pass p
+// covers the bits [begin_bit + 8 * p, end_bit), histogram p goes to
+// digit_hist[p * 256]; where the counters of all passes do not fit in local
+// memory (64-bit keys on a 32 KiB device) fewer copies are kept, and
+// failing that the passes are counted a few per launch
+template <int ipt, class ...Vs, class M, class H>
+void digit_histogram(M &mem, H &buf, size_t n, typename M::template handle<unsigned> &digit_hist, int begin_bit, int end_bit) {
+    using T = typename H::value_type;
+    size_t tiles = (n + 256 * ipt - 1) / (256 * ipt);
+    int passes = digit_hist.size() / 256;
+    size_t local_words = mem.queue().get_device().template get_info<sycl::info::device::local_mem_size>() / sizeof(unsigned);
+    int copies = histogram_copies;
+    while (copies > 1 && (size_t)passes * copies * histogram_stride > local_words) {
+        copies /= 2;
+    }
+    size_t copies_size = copies * histogram_stride;
+    int chunk = std::clamp<int>(local_words / copies_size, 1, passes);
+    mem.fill(digit_hist, 0u);
+    for (int p0 = 0; p0 < passes; p0 += chunk) {
+        int pn = std::min(chunk, passes - p0);
+        mem.submit([&] (sycl::handler &cgh) {
+            sycl::local_accessor<unsigned> count{pn * copies_size, cgh};
+            auto hist = M::read_write(cgh, digit_hist);
+            auto a = M::read(cgh, buf);
+            cgh.parallel_for<KT_radix_sort_digit_histogram<ipt, H, Vs...>>(sycl::nd_range<1>{tiles * 256, 256}, [=] (sycl::nd_item<1> it) {
+                int ii = it.get_local_id(0);
+                int gi = it.get_group(0);
+                bool full = tile_is_full<ipt>(gi, n);
+                for (size_t j = ii; j < pn * copies_size; j += 256) {
+                    count[j] = 0;
+                }
+                it.barrier(sycl::access::fence_space::local_space);
+                size_t copy = histogram_copy(it, copies);
+                for (int r = 0; r < ipt; r++) {
+                    size_t i = (size_t)gi * 256 * ipt + r * 256 + ii;
+                    bool valid = full || i < n;
+                    T x = a[valid ? i : n - 1];
+                    for (int p = 0; p < pn; p++) {
+                        int shift = begin_bit + (p0 + p) * 8;
+                        unsigned key = valid ? radix_digit(x, shift, digit_mask(shift, end_bit)) : 256u;
+                        count_digit(it, count, p * copies_size + copy, key);
+                    }
+                }
+                it.barrier(sycl::access::fence_space::local_space);
+                for (int p = 0; p < pn; p++) {
+                    unsigned c = 0;
+                    for (int k = 0; k < copies; k++) {
+                        c += count[p * copies_size + k * histogram_stride + ii];
+                    }
+                    if (c)
+                        atomic_ref<sycl::memory_order_relaxed, sycl::memory_scope_device>(hist[(p0 + p) * 256 + ii]).fetch_add(c);
+                }
+            });
+        });
+    }
+}
+
+// every work-item handles ipt keys, so one tile of 256 * ipt keys shares one
+// 256-entry histogram: hist_group and its scan shrink by a factor of ipt
+template <int ipt, int sg, bool reorder, class M, class H, class ...Vs, class ...VNs>
+void classic_passes(M &mem, H &buf, H &buf_next,
+                    std::tuple<Vs &...> values, std::tuple<VNs &...> values_next,
+                    int begin_bit, int end_bit, std::vector<int> const &active) {
+    using T = typename H::value_type;
+    auto vseq = std::index_sequence_for<Vs...>{};
+    size_t n = buf.size();
+    size_t tiles = (n + 256 * ipt - 1) / (256 * ipt);
+    auto hist_group = mem.template alloc<unsigned>(tiles * 256);
+    for (int p: active) {
+        int shift = begin_bit + p * 8;
+        unsigned mask = digit_mask(shift, end_bit);
+        mem.submit([&] (sycl::handler &cgh) {
+            sycl::local_accessor<unsigned> count{histogram_copies * histogram_stride, cgh};
+            auto hist = M::write(cgh, hist_group);
+            auto a = M::read(cgh, buf);
+            cgh.parallel_for<KT_radix_sort_histogram<ipt, sg, reorder, H, Vs...>>(sycl::nd_range<1>{tiles * 256, 256}, [=] (sycl::nd_item<1> it) {
                 int ii = it.get_local_id(0);
                 int gi = it.get_group(0);
                 int gn = it.get_group_range(0);
-                int i = it.get_global_id(0);
-                count[ii] = 0;
+                bool full = tile_is_full<ipt>(gi, n);
+                for (int k = 0; k < histogram_copies; k++) {
+                    count[k * histogram_stride + ii] = 0;
+                }
                 it.barrier(sycl::access::fence_space::local_space);
-                unsigned key = (a[i] >> bit * 8) & 0xff;
-                atomic_ref(count[key]).fetch_add(1u);
+                size_t copy = histogram_copy(it);
+                for (int r = 0; r < ipt; r++) {
+                    size_t i = (size_t)gi * 256 * ipt + r * 256 + ii;
+                    unsigned key = full || i < n ? radix_digit(a[i], shift, mask) : 256u;
+                    count_digit(it, count, copy, key);
+                }
                 it.barrier(sycl::access::fence_space::local_space);
-                hist[ii * gn + gi] = count[ii];
+                unsigned c = 0;
+                for (int k = 0; k < histogram_copies; k++) {
+                    c += count[k * histogram_stride + ii];
+                }
+                hist[ii * gn + gi] = c;
             });
         });
-        exclusive_scan(q, hist_group);
-        q.submit([&] (sycl::handler &cgh) {
+        _exclusive_scan_details::exclusive_scan(mem, hist_group);
+        mem.submit([&] (sycl::handler &cgh) {
             sycl::local_accessor<unsigned> count{256, cgh};
-            sycl::local_accessor<unsigned> bits{256 * 9, cgh};
-            sycl::accessor hist{hist_group, cgh, sycl::read_only};
-            sycl::accessor a{buf, cgh, sycl::read_only};
-            sycl::accessor aout{buf_next, cgh, sycl::write_only, sycl::no_init};
-            cgh.parallel_for<KT_radix_sort_scatter>(sycl::nd_range<1>{buf.size(), 256}, [=] (sycl::nd_item<1> it) {
+            sycl::local_accessor<rank_scratch<sg>> bits{rank_scratch_size<sg>, cgh};
+            sycl::local_accessor<T> tile_keys{reorder ? 256 * ipt : 1, cgh};
+            sycl::local_accessor<uint16_t> tile_src{reorder ? 256 * ipt : 1, cgh};
+            sycl::local_accessor<unsigned> local_base{256, cgh};
+            sycl::local_accessor<unsigned> global_base{256, cgh};
+            auto hist = M::read(cgh, hist_group);
+            auto a = M::read(cgh, buf);
+            auto aout = M::write(cgh, buf_next);
+            auto vin = make_accessors<M>(cgh, values, vseq);
+            auto vout = make_accessors_no_init<M>(cgh, values_next, vseq);
+            parallel_for_ranked<KT_radix_sort_scatter<ipt, sg, reorder, H, Vs...>, sg>(cgh, sycl::nd_range<1>{tiles * 256, 256}, [=] (sycl::nd_item<1> it) {
                 int ii = it.get_local_id(0);
                 int gi = it.get_group(0);
                 int gn = it.get_group_range(0);
-                int i = it.get_global_id(0);
-                auto g = it.get_group();
+                bool full = tile_is_full<ipt>(gi, n);
+                size_t tile_base = (size_t)gi * 256 * ipt;
                 count[ii] = hist[ii * gn + gi];
-                for (int k = 0; k < 8; k++) {
-                    bits[ii * 9 + k] = 0u;
+                if constexpr (reorder) {
+                    // the scanned histogram is contiguous over (digit, tile),
+                    // so the next entry minus this one is the tile's count
+                    size_t e = (size_t)ii * gn + gi + 1;
+                    unsigned c = (e < 256 * (size_t)gn ? hist[e] : n) - count[ii];
+                    local_base[ii] = sycl::exclusive_scan_over_group(it.get_group(), c, std::plus<>{});
+                    global_base[ii] = count[ii];
+                }
+                for (int r = 0; r < ipt; r++) {
+                    size_t i = tile_base + r * 256 + ii;
+                    bool valid = full || i < n;
+                    unsigned key = valid ? radix_digit(a[i], shift, mask) : 0u;
+                    unsigned index = rank_keys<sg>(it, bits, count, key, valid);
+                    if (valid) {
+                        if constexpr (reorder) {
+                            size_t pos = index - global_base[key] + local_base[key];
+                            tile_keys[pos] = a[i];
+                            tile_src[pos] = r * 256 + ii;
+                        } else {
+                            aout[index] = a[i];
+                            scatter_values(vin, vout, i, index, vseq);
+                        }
+                    }
+                }
+                if constexpr (reorder)
+                    write_tile_runs(it, tile_keys, tile_src, local_base, global_base, full ? 256 * ipt : n - tile_base,
+                                    tile_base, shift, mask, aout, vin, vout, vseq);
+            });
+        });
+        std::swap(buf, buf_next);
+        swap_buffers(values, values_next, vseq);
+    }
+}
+
+// the keys (with their payloads Vs) the single work-group path holds in
+// local memory: two copies of each next to the counters and ranking scratch
+template <class T, class ...Vs>
+size_t small_capacity(sycl::queue &q, int sg) {
+    size_t local_mem = q.get_device().get_info<sycl::info::device::local_mem_size>();
+    size_t reserved = 256 * sizeof(unsigned) + rank_scratch_bytes(sg);
+    size_t per_key = 2 * (sizeof(T) + (sizeof(Vs) + ... + 0));
+    return local_mem > reserved ? (local_mem - reserved) / per_key : 0;
+}
+
+// inputs that fit in local memory (see small_capacity) are sorted by one
+// work-group in one launch: the keys and payloads are read once into local
+// memory, every pass ping-pongs between its two halves, and the result is
+// written back once; the local scatter needs no coalescing
+template <int sg, class M, class H, class ...Vs>
+void small_passes(M &mem, H &buf, std::tuple<Vs &...> values, int begin_bit, int end_bit, int passes, bool skip_trivial) {
+    using T = typename H::value_type;
+    auto vseq = std::index_sequence_for<Vs...>{};
+    size_t n = buf.size();
+    mem.submit([&] (sycl::handler &cgh) {
+        sycl::local_accessor<unsigned> count{256, cgh};
+        sycl::local_accessor<rank_scratch<sg>> bits{rank_scratch_size<sg>, cgh};
+        sycl::local_accessor<T> keys{2 * n, cgh};
+        std::tuple<sycl::local_accessor<typename Vs::value_type>...> vkeys{
+            sycl::local_accessor<typename Vs::value_type>{2 * n, cgh}...};
+        auto a = M::read_write(cgh, buf);
+        auto va = make_accessors_read_write<M>(cgh, values, vseq);
+        parallel_for_ranked<KT_radix_sort_small<sg, H, Vs...>, sg>(cgh, sycl::nd_range<1>{256, 256}, [=] (sycl::nd_item<1> it) {
+            int ii = it.get_local_id(0);
+            for (size_t j = ii; j < n; j += 256) {
+                keys[j] = a[j];
+                scatter_values(va, vkeys, j, j, vseq);
+            }
+            it.barrier(sycl::access::fence_space::local_space);
+            // the keys are in [src, src + n), the other half is free
+            size_t src = 0;
+            for (int p = 0; p < passes; p++) {
+                int shift = begin_bit + p * 8;
+                unsigned mask = digit_mask(shift, end_bit);
+                size_t dst = n - src;
+                bool moved = group_radix_pass<sg>(it, bits, count, n, [&] (size_t j) {
+                    return radix_digit(keys[src + j], shift, mask);
+                }, [&] (size_t j, unsigned index) {
+                    keys[dst + index] = keys[src + j];
+                    scatter_values(vkeys, vkeys, src + j, dst + index, vseq);
+                }, skip_trivial);
+                if (moved)
+                    src = dst;
+            }
+            for (size_t j = ii; j < n; j += 256) {
+                a[j] = keys[src + j];
+                scatter_values(vkeys, va, src + j, j, vseq);
+            }
+        });
+    });
+}
+
+// look-back status word of one digit of one tile: two flag bits on top of a
+// 30-bit count, so the onesweep engine handles fewer than 2^30 keys and
+// larger inputs take the classic passes (see onesweep_max_keys)
+inline constexpr unsigned status_aggregate = 1u << 30;
+inline constexpr unsigned status_prefix = 2u << 30;
+inline constexpr unsigned status_flags = 3u << 30;
+inline constexpr size_t onesweep_max_keys = status_aggregate - 1;
+
+// digit_hist holds the histograms computed by digit_histogram for every pass
+template <int ipt, int sg, bool reorder, class M, class H, class ...Vs, class ...VNs>
+void onesweep_passes(M &mem, H &buf, H &buf_next,
+                     std::tuple<Vs &...> values, std::tuple<VNs &...> values_next,
+                     int begin_bit, int end_bit, std::vector<int> const &active,
+                     typename M::template handle<unsigned> &digit_hist) {
+    using T = typename H::value_type;
+    auto vseq = std::index_sequence_for<Vs...>{};
+    size_t n = buf.size();
+    size_t tiles = (n + 256 * ipt - 1) / (256 * ipt);
+    auto tile_counter = mem.template alloc<unsigned>(digit_hist.size() / 256);
+    // each pass reads one status buffer and clears the other for the next pass
+    typename M::template handle<unsigned> status[2]{
+        mem.template alloc<unsigned>(tiles * 256), mem.template alloc<unsigned>(tiles * 256)};
+    mem.fill(tile_counter, 0u);
+    mem.fill(status[0], 0u);
+    for (size_t ap = 0; ap < active.size(); ap++) {
+        int p = active[ap];
+        int shift = begin_bit + p * 8;
+        unsigned mask = digit_mask(shift, end_bit);
+        mem.submit([&] (sycl::handler &cgh) {
+            sycl::local_accessor<unsigned> count{256, cgh};
+            sycl::local_accessor<rank_scratch<sg>> bits{rank_scratch_size<sg>, cgh};
+            sycl::local_accessor<unsigned> tile_id{1, cgh};
+            sycl::local_accessor<T> tile_keys{reorder ? 256 * ipt : 1, cgh};
+            sycl::local_accessor<uint16_t> tile_src{reorder ? 256 * ipt : 1, cgh};
+            sycl::local_accessor<unsigned> local_base{256, cgh};
+            sycl::local_accessor<unsigned> global_base{256, cgh};
+            auto hist = M::read(cgh, digit_hist);
+            auto counter = M::read_write(cgh, tile_counter);
+            auto stat = M::read_write(cgh, status[ap % 2]);
+            auto stat_next = M::write(cgh, status[(ap + 1) % 2]);
+            auto a = M::read(cgh, buf);
+            auto aout = M::write(cgh, buf_next);
+            auto vin = make_accessors<M>(cgh, values, vseq);
+            auto vout = make_accessors_no_init<M>(cgh, values_next, vseq);
+            parallel_for_ranked<KT_radix_sort_onesweep_scatter<ipt, sg, reorder, H, Vs...>, sg>(cgh, sycl::nd_range<1>{tiles * 256, 256}, [=] (sycl::nd_item<1> it) {
+                int ii = it.get_local_id(0);
+                // tile ids in start order, see scan_lookback in exclusive_scan.h
+                if (ii == 0)
+                    tile_id[0] = atomic_ref<sycl::memory_order_relaxed, sycl::memory_scope_device>(counter[p]).fetch_add(1u);
+                count[ii] = 0;
+                it.barrier(sycl::access::fence_space::local_space);
+                size_t ti = tile_id[0];
+                bool full = tile_is_full<ipt>(ti, n);
+                T x[ipt];
+                for (int r = 0; r < ipt; r++) {
+                    size_t i = ti * 256 * ipt + r * 256 + ii;
+                    if (full || i < n) {
+                        x[r] = a[i];
+                        atomic_ref(count[radix_digit(x[r], shift, mask)]).fetch_add(1u);
+                    }
                 }
+                unsigned base = sycl::exclusive_scan_over_group(it.get_group(), hist[p * 256 + ii], std::plus<>{});
                 it.barrier(sycl::access::fence_space::local_space);
-                unsigned key = (a[i] >> bit * 8) & 0xff;
-                atomic_ref(bits[key * 9 + (ii >> 5)]).fetch_or(1u << (ii & 31));
+                unsigned c = count[ii];
+                size_t si = ti * 256 + ii;
+                atomic_ref<sycl::memory_order_acq_rel, sycl::memory_scope_device>(stat[si]).store(
+                    (ti == 0 ? status_prefix : status_aggregate) | c);
+                unsigned prefix = 0;
+                for (size_t tj = ti; tj > 0;) {
+                    unsigned s = atomic_ref<sycl::memory_order_acq_rel, sycl::memory_scope_device>(stat[(tj - 1) * 256 + ii]).load();
+                    if (!(s & status_flags))
+                        continue;
+                    prefix += s & ~status_flags;
+                    if (s & status_prefix)
+                        break;
+                    tj--;
+                }
+                if (ti != 0)
+                    atomic_ref<sycl::memory_order_acq_rel, sycl::memory_scope_device>(stat[si]).store(status_prefix | (prefix + c));
+                stat_next[si] = 0;
                 it.barrier(sycl::access::fence_space::local_space);
-                int popcorns = 0;
-                for (int k = 0; k <= (ii >> 5); k++) {
-                    unsigned mask = bits[key * 9 + k];
-                    if (ii < (k + 1) * 32)
-                        mask &= (1u << (ii & 31)) - 1u;
-#if defined(__GNUC__) && defined(__OPENSYCL__)
-                    popcorns += __builtin_popcount(mask);
-#else
-                    popcorns += sycl::popcount(mask);
-#endif
+                count[ii] = base + prefix;
+                if constexpr (reorder) {
+                    local_base[ii] = sycl::exclusive_scan_over_group(it.get_group(), c, std::plus<>{});
+                    global_base[ii] = base + prefix;
                 }
-                unsigned index = count[key] + popcorns;
-                aout[index] = a[i];
+                size_t tile_base = ti * 256 * ipt;
+                for (int r = 0; r < ipt; r++) {
+                    size_t i = tile_base + r * 256 + ii;
+                    bool valid = full || i < n;
+                    unsigned key = valid ? radix_digit(x[r], shift, mask) : 0u;
+                    unsigned index = rank_keys<sg>(it, bits, count, key, valid);
+                    if (valid) {
+                        if constexpr (reorder) {
+                            size_t pos = index - global_base[key] + local_base[key];
+                            tile_keys[pos] = x[r];
+                            tile_src[pos] = r * 256 + ii;
+                        } else {
+                            aout[index] = x[r];
+                            scatter_values(vin, vout, i, index, vseq);
+                        }
+                    }
+                }
+                if constexpr (reorder)
+                    write_tile_runs(it, tile_keys, tile_src, local_base, global_base, full ? 256 * ipt : n - tile_base,
+                                    tile_base, shift, mask, aout, vin, vout, vseq);
             });
         });
         std::swap(buf, buf_next);
+        swap_buffers(values, values_next, vseq);
+    }
+}
+
+}
+
+// keys handled by each work-item of the histogram and scatter kernels
+inline constexpr int radix_sort_items_per_thread = 16;
+
+enum class radix_sort_ranking {
+    // ballot when the device supports sub-groups of 32 or 16 lanes, else bitmap
+    automatic,
+    // per-digit bitmasks of the work-group in local memory, any device
+    bitmap,
+    // sub-group ballots and per-sub-group digit counts with the kernels
+    // pinned to sub-groups of 32 lanes, else 16; the bitmap on devices
+    // supporting neither
+    ballot,
+};
+
+enum class radix_sort_backend {
+    // host on CPU devices when no option of the kernels is set, see
+    // use_host_backend; device otherwise
+    automatic,
+    // the SYCL kernels on the queue's device
+    device,
+    // the native host sort of host_radix_sort.h in a host task of the
+    // queue, for keys and payloads the host can address
+    host,
+};
+
+struct radix_sort_options {
+    // only the bits [begin_bit, end_bit) of the order-preserving representation
+    // of the keys (see radix_traits.h) are sorted, end_bit < 0 means all bits;
+    // the sorts throw std::invalid_argument unless
+    // 0 <= begin_bit <= end_bit <= radix_bits<T>
+    int begin_bit = 0;
+    int end_bit = -1;
+    // count every digit upfront and drop the passes where all keys fall into
+    // a single bucket, costs one read of the keys and one host round-trip
+    bool skip_trivial_passes = false;
+    // inputs up to this many keys take the single work-group path where they
+    // fit in local memory, which alone bounds it by default; 0 disables it
+    size_t small_size = std::numeric_limits<size_t>::max();
+    // how the scatter kernels rank the keys of a tile
+    radix_sort_ranking ranking = radix_sort_ranking::automatic;
+    // stage every tile in local memory ordered by digit and write each
+    // digit's keys and payloads as one contiguous run instead of scattering
+    // them one by one, where the device has the local memory for it
+    bool coalesced_scatter = true;
+    // which implementation sorts, see radix_sort_backend
+    radix_sort_backend backend = radix_sort_backend::automatic;
+    // where the USM overloads take their temporaries from, see device_memory.h
+    temp_storage temp;
+};
+
+namespace _radix_sort_details {
+
+// the sub-group size the scatter kernels rank by ballot with: 32 where the
+// device supports it, else 16, else 0 for the bitmap; without
+// CLIB_REQD_SUB_GROUP_SIZE only a device with a single sub-group size
+// guarantees the kernels get it
+inline int ranking_sub_group_size(sycl::queue &q, radix_sort_ranking ranking) {
+    if (ranking == radix_sort_ranking::bitmap)
+        return 0;
+    auto sizes = q.get_device().get_info<sycl::info::device::sub_group_sizes>();
+#ifndef CLIB_REQD_SUB_GROUP_SIZE
+    if (sizes.size() != 1)
+        return 0;
+#endif
+    for (int sg: {32, 16}) {
+        if (std::find(sizes.begin(), sizes.end(), (size_t)sg) != sizes.end())
+            return sg;
+    }
+    return 0;
+}
+
+// whether the staged tile of the coalesced scatter fits in local memory
+// next to the other local arrays of the scatter kernels
+template <class T, int ipt>
+bool staging_fits(sycl::queue &q, int sg) {
+    size_t bytes = 256 * ipt * (sizeof(T) + sizeof(uint16_t)) + 4 * 256 * sizeof(unsigned) + rank_scratch_bytes(sg);
+    return bytes <= q.get_device().get_info<sycl::info::device::local_mem_size>();
+}
+
+// the end of the bit range of opts for keys of T, end_bit < 0 standing for
+// radix_bits<T>; throws std::invalid_argument for a range outside the key
+// or with begin_bit > end_bit
+template <class T>
+int checked_end_bit(radix_sort_options const &opts) {
+    int end_bit = opts.end_bit < 0 ? radix_bits<T> : opts.end_bit;
+    if (opts.begin_bit < 0 || opts.begin_bit > end_bit || end_bit > radix_bits<T>)
+        throw std::invalid_argument("radix_sort: bit range not within [0, radix_bits<T>] in order");
+    return end_bit;
+}
+
+// whether the host can dereference the USM pointer p of q's context
+inline bool host_addressable(sycl::queue &q, void const *p) {
+    return sycl::get_pointer_type(p, q.get_context()) != sycl::usm::alloc::device;
+}
+
+// whether the sort runs on the host: always for backend::host, and for
+// automatic only on a CPU device when every option of the kernels (engine,
+// ipt, ranking, coalesced_scatter, small_size) is left at its default, so
+// asking for a kernel variant always gets it; usm holds the USM pointers
+// of the keys and payloads, device allocations never take the host sort
+template <radix_sort_engine engine, int ipt, class ...Ps>
+bool use_host_backend(sycl::queue &q, radix_sort_options const &opts, Ps *...usm) {
+    bool addressable = (host_addressable(q, usm) && ...);
+    if (opts.backend == radix_sort_backend::host && !addressable)
+        throw std::invalid_argument("radix_sort: backend::host on USM device allocations");
+    if (opts.backend != radix_sort_backend::automatic)
+        return opts.backend == radix_sort_backend::host;
+    radix_sort_options defaults;
+    bool kernel_defaults = engine == radix_sort_engine::classic && ipt == radix_sort_items_per_thread
+                        && opts.ranking == defaults.ranking && opts.coalesced_scatter == defaults.coalesced_scatter
+                        && opts.small_size == defaults.small_size;
+    return kernel_defaults && addressable && q.get_device().is_cpu();
+}
+
+template <class T, class ...Vs>
+void host_sort(radix_sort_options const &opts, T *keys, size_t n, Vs *...values) {
+    int end_bit = checked_end_bit<T>(opts);
+    _host_radix_sort_details::sort(keys, n, opts.begin_bit, end_bit, values...);
+}
+
+// calls f with a std::bool_constant for the runtime flag b
+template <class F>
+void with_flag(F f, bool b) {
+    if (b)
+        f(std::true_type{});
+    else
+        f(std::false_type{});
+}
+
+// calls f with a std::integral_constant for the ranking sub-group size sg
+// (see ranking_sub_group_size) and a std::bool_constant for reorder
+template <class F>
+void with_ranking(F f, int sg, bool reorder) {
+    with_flag([&] (auto r) {
+        if (sg == 32)
+            f(std::integral_constant<int, 32>{}, r);
+        else if (sg == 16)
+            f(std::integral_constant<int, 16>{}, r);
+        else
+            f(std::integral_constant<int, 0>{}, r);
+    }, reorder);
+}
+
+template <radix_sort_engine engine, int ipt, class M, class H, class ...Vs>
+void radix_sort_by_key(M &mem, radix_sort_options const &opts, H &buf, Vs &...values) {
+    using T = typename H::value_type;
+    auto vseq = std::index_sequence_for<Vs...>{};
+    size_t n = buf.size();
+    int begin_bit = opts.begin_bit;
+    int end_bit = checked_end_bit<T>(opts);
+    if (n <= 1 || begin_bit >= end_bit) return;
+    int passes = (end_bit - begin_bit + 7) / 8;
+    int sg = ranking_sub_group_size(mem.queue(), opts.ranking);
+    if (n <= std::min(opts.small_size, small_capacity<T, typename Vs::value_type...>(mem.queue(), sg))) {
+        with_ranking([&] (auto sg_size, auto) {
+            small_passes<decltype(sg_size)::value>(mem, buf, std::tie(values...), begin_bit, end_bit, passes,
+                                                   opts.skip_trivial_passes);
+        }, sg, false);
+        return;
+    }
+    std::vector<int> active;
+    for (int p = 0; p < passes; p++) {
+        active.push_back(p);
+    }
+    // a digit count of 2^30 would spill into the flags of the status words
+    bool onesweep = engine == radix_sort_engine::onesweep && n <= onesweep_max_keys;
+    std::optional<typename M::template handle<unsigned>> digit_hist;
+    if (onesweep || opts.skip_trivial_passes) {
+        digit_hist.emplace(mem.template alloc<unsigned>(passes * 256));
+        digit_histogram<ipt, Vs...>(mem, buf, n, *digit_hist, begin_bit, end_bit);
+    }
+    if (opts.skip_trivial_passes) {
+        std::vector<unsigned> hist = mem.to_host(*digit_hist);
+        active.clear();
+        for (int p = 0; p < passes; p++) {
+            if (std::find(&hist[p * 256], &hist[p * 256] + 256, n) == &hist[p * 256] + 256)
+                active.push_back(p);
+        }
+    }
+    H buf_next = mem.template alloc<T>(n);
+    std::tuple<Vs...> values_next_bufs{mem.template alloc<typename Vs::value_type>(values.size())...};
+    auto values_next = std::apply([] (auto &...b) { return std::tie(b...); }, values_next_bufs);
+    bool coalesced = opts.coalesced_scatter && staging_fits<T, ipt>(mem.queue(), sg);
+    with_ranking([&] (auto sg_size, auto reorder) {
+        if constexpr (engine == radix_sort_engine::onesweep) {
+            if (onesweep) {
+                onesweep_passes<ipt, decltype(sg_size)::value, decltype(reorder)::value>(
+                    mem, buf, buf_next, std::tie(values...), values_next, begin_bit, end_bit, active, *digit_hist);
+                return;
+            }
+        }
+        classic_passes<ipt, decltype(sg_size)::value, decltype(reorder)::value>(
+            mem, buf, buf_next, std::tie(values...), values_next, begin_bit, end_bit, active);
+    }, sg, coalesced);
+    if (active.size() % 2) {
+        std::swap(buf, buf_next);
+        swap_buffers(std::tie(values...), values_next, vseq);
+        mem.copy(buf_next, buf);
+        std::apply([&] (auto &...vnext) {
+            (mem.copy(vnext, values), ...);
+        }, values_next);
+    }
+}
+
+// indices[i] = i; kept apart from radix_argsort so that one kernel serves
+// every key type, engine and ipt under the name KT_radix_argsort_iota<HI>
+template <class M, class HI>
+void iota_indices(M &mem, HI &indices) {
+    using I = typename HI::value_type;
+    mem.submit([&] (sycl::handler &cgh) {
+        auto idx = M::write(cgh, indices);
+        cgh.parallel_for<KT_radix_argsort_iota<HI>>(sycl::range<1>{indices.size()}, [=] (sycl::id<1> i) {
+            idx[i] = static_cast<I>(i[0]);
+        });
+    });
+}
+
+template <radix_sort_engine engine, int ipt, class M, class H, class HI>
+void radix_argsort(M &mem, radix_sort_options const &opts, H &keys, HI &indices) {
+    H keys_copy = mem.template alloc<typename H::value_type>(keys.size());
+    mem.copy(keys, keys_copy);
+    iota_indices(mem, indices);
+    radix_sort_by_key<engine, ipt>(mem, opts, keys_copy, indices);
+}
+
+}
+
+// stably sorts keys of any integral or floating point type in ascending order,
+// one 8-bit digit per pass over the bit range of opts (sizeof(T) passes for
+// the full range); every payload buffer in values is permuted along with the
+// keys using the rank computed for the key; buf may have any length; on a
+// CPU device the default options sort natively on the host (see opts.backend)
+template <radix_sort_engine engine = radix_sort_engine::classic, int ipt = radix_sort_items_per_thread, class T, class ...Vs>
+void radix_sort_by_key(sycl::queue &q, radix_sort_options const &opts, sycl::buffer<T> &buf, sycl::buffer<Vs> &...values) {
+    // the host task would only report a bad bit range asynchronously
+    _radix_sort_details::checked_end_bit<T>(opts);
+    if (_radix_sort_details::use_host_backend<engine, ipt>(q, opts)) {
+        if (buf.size() <= 1) return;
+        q.submit([&] (sycl::handler &cgh) {
+            sycl::accessor keys{buf, cgh, sycl::read_write};
+            std::tuple vs{sycl::accessor{values, cgh, sycl::read_write}...};
+            cgh.host_task([=] {
+                std::apply([&] (auto const &...v) {
+                    _radix_sort_details::host_sort(opts, &keys[0], keys.size(), &v[0]...);
+                }, vs);
+            });
+        });
+        return;
+    }
+    buffer_memory mem{q};
+    _radix_sort_details::radix_sort_by_key<engine, ipt>(mem, opts, buf, values...);
+}
+
+template <radix_sort_engine engine = radix_sort_engine::classic, int ipt = radix_sort_items_per_thread, class T, class ...Vs>
+void radix_sort_by_key(sycl::queue &q, sycl::buffer<T> &buf, sycl::buffer<Vs> &...values) {
+    radix_sort_by_key<engine, ipt>(q, radix_sort_options{}, buf, values...);
+}
+
+template <radix_sort_engine engine = radix_sort_engine::classic, int ipt = radix_sort_items_per_thread, class T>
+void radix_sort(sycl::queue &q, sycl::buffer<T> &buf, radix_sort_options const &opts = {}) {
+    radix_sort_by_key<engine, ipt>(q, opts, buf);
+}
+
+// the same natively on the host without any SYCL device, see
+// host_radix_sort.h; opts.temp and the options of the kernels do not apply
+template <class T, class ...Vs>
+void host_radix_sort_by_key(radix_sort_options const &opts, T *keys, size_t n, Vs *...values) {
+    _radix_sort_details::host_sort(opts, keys, n, values...);
+}
+
+template <class T>
+void host_radix_sort(T *keys, size_t n, radix_sort_options const &opts = {}) {
+    _radix_sort_details::host_sort(opts, keys, n);
+}
+
+template <class T>
+void host_radix_sort(std::vector<T> &keys, radix_sort_options const &opts = {}) {
+    _radix_sort_details::host_sort(opts, keys.data(), keys.size());
+}
+
+// writes into indices the stable permutation that sorts keys, keys are left untouched
+template <radix_sort_engine engine = radix_sort_engine::classic, int ipt = radix_sort_items_per_thread, class T, class I>
+void radix_argsort(sycl::queue &q, sycl::buffer<T> &keys, sycl::buffer<I> &indices, radix_sort_options const &opts = {}) {
+    buffer_memory mem{q};
+    _radix_sort_details::radix_argsort<engine, ipt>(mem, opts, keys, indices);
+}
+
+// the same on device or shared USM: n keys and n elements of every values
+// array, the sort starts once deps are done and the event of its last
+// command is returned without waiting, temporaries are freed asynchronously
+template <radix_sort_engine engine = radix_sort_engine::classic, int ipt = radix_sort_items_per_thread, class T, class ...Vs>
+sycl::event radix_sort_by_key(sycl::queue &q, radix_sort_options const &opts, std::vector<sycl::event> const &deps,
+                              T *keys, size_t n, Vs *...values) {
+    _radix_sort_details::checked_end_bit<T>(opts);
+    if (_radix_sort_details::use_host_backend<engine, ipt>(q, opts, keys, values...)) {
+        return q.submit([&] (sycl::handler &cgh) {
+            cgh.depends_on(deps);
+            cgh.host_task([=] {
+                _radix_sort_details::host_sort(opts, keys, n, values...);
+            });
+        });
     }
+    usm_memory mem{q, deps, opts.temp};
+    usm_span<T> keys_span{keys, n};
+    std::tuple<usm_span<Vs>...> values_spans{usm_span<Vs>{values, n}...};
+    std::apply([&] (auto &...vs) {
+        _radix_sort_details::radix_sort_by_key<engine, ipt>(mem, opts, keys_span, vs...);
+    }, values_spans);
+    return mem.finish();
+}
+
+template <radix_sort_engine engine = radix_sort_engine::classic, int ipt = radix_sort_items_per_thread, class T, class ...Vs>
+sycl::event radix_sort_by_key(sycl::queue &q, std::vector<sycl::event> const &deps, T *keys, size_t n, Vs *...values) {
+    return radix_sort_by_key<engine, ipt>(q, radix_sort_options{}, deps, keys, n, values...);
+}
+
+template <radix_sort_engine engine = radix_sort_engine::classic, int ipt = radix_sort_items_per_thread, class T>
+sycl::event radix_sort(sycl::queue &q, T *keys, size_t n, std::vector<sycl::event> const &deps = {}, radix_sort_options const &opts = {}) {
+    return radix_sort_by_key<engine, ipt>(q, opts, deps, keys, n);
+}
+
+template <radix_sort_engine engine = radix_sort_engine::classic, int ipt = radix_sort_items_per_thread, class T, class I>
+sycl::event radix_argsort(sycl::queue &q, T const *keys, I *indices, size_t n, std::vector<sycl::event> const &deps = {}, radix_sort_options const &opts = {}) {
+    usm_memory mem{q, deps, opts.temp};
+    usm_span<T> keys_span{const_cast<T *>(keys), n};
+    usm_span<I> indices_span{indices, n};
+    _radix_sort_details::radix_argsort<engine, ipt>(mem, opts, keys_span, indices_span);
+    return mem.finish();
+}
+
+// bytes of opts.temp.ptr the USM radix_sort_by_key of n keys with payloads
+// of types Vs needs under the same engine, ipt and opts
+template <radix_sort_engine engine = radix_sort_engine::classic, int ipt = radix_sort_items_per_thread, class T, class ...Vs>
+size_t radix_sort_temp_storage_bytes(sycl::queue &q, size_t n, radix_sort_options const &opts = {}) {
+    usm_memory mem{q, usm_memory::measure_tag{}};
+    usm_span<T> keys_span{nullptr, n};
+    std::tuple<usm_span<Vs>...> values_spans{usm_span<Vs>{nullptr, n}...};
+    std::apply([&] (auto &...vs) {
+        _radix_sort_details::radix_sort_by_key<engine, ipt>(mem, opts, keys_span, vs...);
+    }, values_spans);
+    return mem.used_bytes();
+}
+
+template <radix_sort_engine engine = radix_sort_engine::classic, int ipt = radix_sort_items_per_thread, class T, class I>
+size_t radix_argsort_temp_storage_bytes(sycl::queue &q, size_t n, radix_sort_options const &opts = {}) {
+    usm_memory mem{q, usm_memory::measure_tag{}};
+    usm_span<T> keys_span{nullptr, n};
+    usm_span<I> indices_span{nullptr, n};
+    _radix_sort_details::radix_argsort<engine, ipt>(mem, opts, keys_span, indices_span);
+    return mem.used_bytes();
 }
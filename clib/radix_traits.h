@@ -0,0 +1,68 @@
+#pragma once
+
+#include <sycl/sycl.hpp>
+#include <cstdint>
+#include <type_traits>
+
+// maps a key to an unsigned integer of the same width whose unsigned order
+// matches the key's order, so the radix passes can work on raw digits:
+//   unsigned: unchanged
+//   signed:   flip the sign bit
+//   float:    flip the sign bit of positives, all bits of negatives;
+//             -0 is encoded as +0 (so they stay stable relative to each other)
+//             and every NaN is encoded as all ones (sorted last, like std::sort
+//             with NaNs moved to the tail)
+template <class T, class = void>
+struct radix_traits;
+
+template <class T>
+struct radix_traits<T, std::enable_if_t<std::is_integral_v<T> && std::is_unsigned_v<T>>> {
+    using bits_type = T;
+
+    static bits_type to_bits(T x) {
+        return x;
+    }
+};
+
+template <class T>
+struct radix_traits<T, std::enable_if_t<std::is_integral_v<T> && std::is_signed_v<T>>> {
+    using bits_type = std::make_unsigned_t<T>;
+
+    static bits_type to_bits(T x) {
+        return static_cast<bits_type>(x) ^ (bits_type(1) << (sizeof(T) * 8 - 1));
+    }
+};
+
+template <class T>
+struct radix_traits<T, std::enable_if_t<std::is_floating_point_v<T>>> {
+    static_assert(sizeof(T) == 4 || sizeof(T) == 8, "only IEEE binary32 and binary64 are supported");
+    using bits_type = std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>;
+
+    static bits_type to_bits(T x) {
+        constexpr bits_type sign = bits_type(1) << (sizeof(T) * 8 - 1);
+        if (x != x) return ~bits_type(0);
+        if (x == 0) return sign;
+        bits_type b = sycl::bit_cast<bits_type>(x);
+        return b & sign ? ~b : b | sign;
+    }
+};
+
+// number of bits of the order-preserving representation of T
+template <class T>
+inline constexpr int radix_bits = sizeof(typename radix_traits<T>::bits_type) * 8;
+
+// the digit of x made of the bits [shift, shift + 8) of its order-preserving
+// representation, mask drops the bits of a last digit narrower than 8 bits
+template <class T>
+unsigned radix_digit(T x, int shift, unsigned mask = 0xff) {
+    return static_cast<unsigned>((radix_traits<T>::to_bits(x) >> shift) & mask);
+}
+
+// the order radix_sort sorts in as a comparator, for merging and searching
+// its output consistently on -0 and NaN
+template <class T>
+struct radix_less {
+    bool operator()(T const &a, T const &b) const {
+        return radix_traits<T>::to_bits(a) < radix_traits<T>::to_bits(b);
+    }
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <sycl/sycl.hpp>
+#include <tuple>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "device_memory.h"
+
+template <int ipt, class H, class R, class Op, class F>
+class KT_reduce_tiles;
+template <int ipt, class H, class R, class Op, class F>
+class KT_reduce_partials;
+
+// elements every work-item folds sequentially before the work-group combine
+inline constexpr int reduce_items_per_thread = 16;
+
+// several reductions of the same elements in one pass, over std::tuple
+// values: fuse(sycl::minimum<>{}, sycl::maximum<>{}, std::plus<>{}) with a
+// transform x -> std::tuple{x, x, x} gives min, max and sum at once
+template <class ...Ops>
+struct fused_op {
+    std::tuple<Ops...> ops;
+
+    template <class ...Ts>
+    std::tuple<Ts...> operator()(std::tuple<Ts...> const &a, std::tuple<Ts...> const &b) const {
+        return apply(a, b, std::index_sequence_for<Ts...>{});
+    }
+
+private:
+    template <class ...Ts, size_t ...Is>
+    std::tuple<Ts...> apply(std::tuple<Ts...> const &a, std::tuple<Ts...> const &b, std::index_sequence<Is...>) const {
+        return {std::get<Is>(ops)(std::get<Is>(a), std::get<Is>(b))...};
+    }
+};
+
+template <class ...Ops>
+fused_op<Ops...> fuse(Ops ...ops) {
+    return {{ops...}};
+}
+
+namespace _reduce_details {
+
+// reduces the values of work-items 0..count-1 of a work-group of 256 in
+// order; built-in operators go through reduce_over_group with their
+// identity filling the rest, any other op through a tree in local memory
+template <class T, class Loc, class Op>
+T group_reduce(sycl::nd_item<1> const &it, Loc const &loc, T x, int count, Op op) {
+    int ii = it.get_local_id(0);
+    if constexpr (sycl::has_known_identity_v<Op, T>) {
+        return sycl::reduce_over_group(it.get_group(), ii < count ? x : sycl::known_identity_v<Op, T>, op);
+    } else {
+        loc[ii] = x;
+        for (int d = 1; d < 256; d *= 2) {
+            it.barrier(sycl::access::fence_space::local_space);
+            if (ii % (2 * d) == 0 && ii + d < count)
+                loc[ii] = op(loc[ii], loc[ii + d]);
+        }
+        it.barrier(sycl::access::fence_space::local_space);
+        return loc[0];
+    }
+}
+
+// result[0] = init op f(data[0]) op ... op f(data[n - 1]): every tile of
+// 256 * ipt elements folds to one partial, and a single work-group folds
+// the partials (or the only tile writes result itself)
+template <int ipt, class M, class H, class HR, class Op, class F>
+void transform_reduce(M &mem, H &data, HR &result, typename HR::value_type init, Op op, F f) {
+    using R = typename HR::value_type;
+    size_t n = data.size();
+    if (n == 0) {
+        mem.fill(result, init);
+        return;
+    }
+    size_t tiles = (n + 256 * ipt - 1) / (256 * ipt);
+    auto partials = mem.template alloc<R>(tiles);
+    mem.submit([&] (sycl::handler &cgh) {
+        sycl::local_accessor<R> loc{256, cgh};
+        auto a = M::read(cgh, data);
+        auto part = M::write(cgh, partials);
+        auto res = M::write(cgh, result);
+        cgh.parallel_for<KT_reduce_tiles<ipt, H, R, Op, F>>(sycl::nd_range<1>{tiles * 256, 256}, [=] (sycl::nd_item<1> it) {
+            int ii = it.get_local_id(0);
+            int gi = it.get_group(0);
+            size_t tile_base = (size_t)gi * 256 * ipt;
+            size_t base = tile_base + (size_t)ii * ipt;
+            int count = std::min<size_t>((n - tile_base + ipt - 1) / ipt, 256);
+            bool full = tile_base + 256 * ipt <= n;
+            R x = f(a[std::min(base, n - 1)]);
+            for (int r = 1; r < ipt; r++) {
+                if (full || base + r < n)
+                    x = op(x, f(a[base + r]));
+            }
+            R total = group_reduce(it, loc, x, count, op);
+            if (ii == 0) {
+                if (tiles == 1)
+                    res[0] = op(init, total);
+                else
+                    part[gi] = total;
+            }
+        });
+    });
+    if (tiles == 1) return;
+    mem.submit([&] (sycl::handler &cgh) {
+        sycl::local_accessor<R> loc{256, cgh};
+        auto part = M::read(cgh, partials);
+        auto res = M::write(cgh, result);
+        cgh.parallel_for<KT_reduce_partials<ipt, H, R, Op, F>>(sycl::nd_range<1>{256, 256}, [=] (sycl::nd_item<1> it) {
+            int ii = it.get_local_id(0);
+            size_t chunk = (tiles + 255) / 256;
+            size_t begin = std::min(ii * chunk, tiles);
+            size_t end = std::min(begin + chunk, tiles);
+            int count = (tiles + chunk - 1) / chunk;
+            R x = part[std::min(begin, tiles - 1)];
+            for (size_t j = begin + 1; j < end; j++) {
+                x = op(x, part[j]);
+            }
+            R total = group_reduce(it, loc, x, count, op);
+            if (ii == 0)
+                res[0] = op(init, total);
+        });
+    });
+}
+
+struct identity {
+    template <class T>
+    T operator()(T const &x) const {
+        return x;
+    }
+};
+
+}
+
+// folds buf under the associative op into result[0], which stays on the
+// device for the next command to consume; transform_reduce folds f(x)
+template <int ipt = reduce_items_per_thread, class T, class R, class Op, class F>
+void transform_reduce(sycl::queue &q, sycl::buffer<T> &buf, sycl::buffer<R> &result, R init, Op op, F f) {
+    buffer_memory mem{q};
+    _reduce_details::transform_reduce<ipt>(mem, buf, result, init, op, f);
+}
+
+template <int ipt = reduce_items_per_thread, class T, class Op = std::plus<>>
+void reduce(sycl::queue &q, sycl::buffer<T> &buf, sycl::buffer<T> &result, T init, Op op = {}) {
+    buffer_memory mem{q};
+    _reduce_details::transform_reduce<ipt>(mem, buf, result, init, op, _reduce_details::identity{});
+}
+
+// the same on device or shared USM, *result is written by the command
+// whose event is returned
+template <int ipt = reduce_items_per_thread, class T, class R, class Op, class F>
+sycl::event transform_reduce(sycl::queue &q, T const *data, size_t n, R *result, R init, Op op, F f,
+                             std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<T> s{const_cast<T *>(data), n};
+    usm_span<R> res{result, 1};
+    _reduce_details::transform_reduce<ipt>(mem, s, res, init, op, f);
+    return mem.finish();
+}
+
+template <int ipt = reduce_items_per_thread, class T, class Op = std::plus<>>
+sycl::event reduce(sycl::queue &q, T const *data, size_t n, T *result, T init, Op op = {},
+                   std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    return transform_reduce<ipt>(q, data, n, result, init, op, _reduce_details::identity{}, deps, temp);
+}
+
+// bytes of temp_storage the USM reductions of n elements to an R need
+template <int ipt = reduce_items_per_thread, class R>
+size_t reduce_temp_storage_bytes(sycl::queue &q, size_t n) {
+    usm_memory mem{q, usm_memory::measure_tag{}};
+    usm_span<R> s{nullptr, n};
+    usm_span<R> res{nullptr, 1};
+    _reduce_details::transform_reduce<ipt>(mem, s, res, R{}, std::plus<>{}, _reduce_details::identity{});
+    return mem.used_bytes();
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <sycl/sycl.hpp>
+#include <vector>
+#include "device_memory.h"
+#include "exclusive_scan.h"
+
+template <class H, class HS, class Op, bool inclusive, bool by_key>
+class KT_segmented_scan;
+template <class Name>
+class KT_segmented_scan_pack;
+template <class Name>
+class KT_segmented_scan_unpack;
+
+namespace _segmented_scan_details {
+
+template <class T>
+struct segmented_value {
+    unsigned head;
+    T value;
+};
+
+// (head, value) pairs scanned under this op restart at every head, so a
+// segmented scan is a plain scan of them and keeps its single pass
+template <class Op>
+struct segmented_op {
+    Op op;
+
+    template <class T>
+    segmented_value<T> operator()(segmented_value<T> const &a, segmented_value<T> const &b) const {
+        return {a.head | b.head, b.head ? b.value : op(a.value, b.value)};
+    }
+};
+
+template <class M, class HF>
+auto bind_head_flags(HF &flags) {
+    return [&flags] (sycl::handler &cgh) {
+        auto f = M::read(cgh, flags);
+        return [=] (size_t i) -> unsigned {
+            return i == 0 || f[i] != 0;
+        };
+    };
+}
+
+template <class M, class HK>
+auto bind_key_changes(HK &keys) {
+    return [&keys] (sycl::handler &cgh) {
+        auto k = M::read(cgh, keys);
+        return [=] (size_t i) -> unsigned {
+            return i == 0 || !(k[i] == k[i - 1]);
+        };
+    };
+}
+
+// in place; the heads of an exclusive scan start from init, which makes its
+// result at a non-head i the exclusive pair scan at i, and init at a head
+template <scan_engine engine, bool inclusive, int ipt, class Name, class M, class H, class BindHead, class Op>
+void segmented_scan(M &mem, H &data, BindHead bind_head, typename H::value_type init, Op op) {
+    using T = typename H::value_type;
+    using S = segmented_value<T>;
+    size_t n = data.size();
+    if (n == 0) return;
+    segmented_op<Op> sop{op};
+    if constexpr (engine == scan_engine::lookback) {
+        _exclusive_scan_details::scan_lookback<inclusive, ipt, Name>(mem, n, [&] (sycl::handler &cgh) {
+            auto head = bind_head(cgh);
+            auto a = M::read_write(cgh, data);
+            return _exclusive_scan_details::scan_io{[=] (size_t i) {
+                unsigned h = head(i);
+                return S{h, !inclusive && h ? op(init, a[i]) : a[i]};
+            }, [=] (size_t i, S v) {
+                a[i] = inclusive || !head(i) ? v.value : init;
+            }};
+        }, false, S{}, sop);
+    } else {
+        auto pairs = mem.template alloc<S>(n);
+        mem.submit([&] (sycl::handler &cgh) {
+            auto head = bind_head(cgh);
+            auto a = M::read(cgh, data);
+            auto p = M::write(cgh, pairs);
+            cgh.parallel_for<KT_segmented_scan_pack<Name>>(sycl::range<1>{n}, [=] (sycl::id<1> i) {
+                unsigned h = head(i);
+                p[i] = S{h, !inclusive && h ? op(init, a[i]) : a[i]};
+            });
+        });
+        _exclusive_scan_details::scan_recursive<true, ipt>(mem, pairs, false, S{}, sop);
+        mem.submit([&] (sycl::handler &cgh) {
+            auto head = bind_head(cgh);
+            auto p = M::read(cgh, pairs);
+            auto a = M::write(cgh, data);
+            cgh.parallel_for<KT_segmented_scan_unpack<Name>>(sycl::range<1>{n}, [=] (sycl::id<1> i) {
+                if constexpr (inclusive) {
+                    a[i] = p[i].value;
+                } else {
+                    a[i] = head(i) ? init : p[i - 1].value;
+                }
+            });
+        });
+    }
+}
+
+template <scan_engine engine, bool inclusive, int ipt, class M, class H, class HF, class Op>
+void segmented_scan_flags(M &mem, H &data, HF &flags, typename H::value_type init, Op op) {
+    using Name = KT_segmented_scan<H, HF, Op, inclusive, false>;
+    segmented_scan<engine, inclusive, ipt, Name>(mem, data, bind_head_flags<M>(flags), init, op);
+}
+
+template <scan_engine engine, bool inclusive, int ipt, class M, class H, class HK, class Op>
+void scan_by_key(M &mem, HK &keys, H &data, typename H::value_type init, Op op) {
+    using Name = KT_segmented_scan<H, HK, Op, inclusive, true>;
+    segmented_scan<engine, inclusive, ipt, Name>(mem, data, bind_key_changes<M>(keys), init, op);
+}
+
+}
+
+// scans buf in place restarting at every segment head, all segments in one
+// device-wide pass: flags[i] != 0 starts a segment at i (i == 0 always
+// does); the exclusive scan gives every head init
+template <scan_engine engine = scan_engine::lookback, int ipt = scan_items_per_thread, class T, class F, class Op = std::plus<>>
+void segmented_inclusive_scan(sycl::queue &q, sycl::buffer<T> &buf, sycl::buffer<F> &flags, Op op = {}) {
+    buffer_memory mem{q};
+    _segmented_scan_details::segmented_scan_flags<engine, true, ipt>(mem, buf, flags, T{}, op);
+}
+
+template <scan_engine engine = scan_engine::lookback, int ipt = scan_items_per_thread, class T, class F, class Op = std::plus<>>
+void segmented_exclusive_scan(sycl::queue &q, sycl::buffer<T> &buf, sycl::buffer<F> &flags, T init, Op op = {}) {
+    buffer_memory mem{q};
+    _segmented_scan_details::segmented_scan_flags<engine, false, ipt>(mem, buf, flags, init, op);
+}
+
+// the same with segments being the runs of equal keys
+template <scan_engine engine = scan_engine::lookback, int ipt = scan_items_per_thread, class K, class T, class Op = std::plus<>>
+void inclusive_scan_by_key(sycl::queue &q, sycl::buffer<K> &keys, sycl::buffer<T> &buf, Op op = {}) {
+    buffer_memory mem{q};
+    _segmented_scan_details::scan_by_key<engine, true, ipt>(mem, keys, buf, T{}, op);
+}
+
+template <scan_engine engine = scan_engine::lookback, int ipt = scan_items_per_thread, class K, class T, class Op = std::plus<>>
+void exclusive_scan_by_key(sycl::queue &q, sycl::buffer<K> &keys, sycl::buffer<T> &buf, T init, Op op = {}) {
+    buffer_memory mem{q};
+    _segmented_scan_details::scan_by_key<engine, false, ipt>(mem, keys, buf, init, op);
+}
+
+template <scan_engine engine = scan_engine::lookback, int ipt = scan_items_per_thread, class T, class F, class Op = std::plus<>>
+sycl::event segmented_inclusive_scan(sycl::queue &q, T *data, F const *flags, size_t n, Op op = {},
+                                     std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<T> s{data, n};
+    usm_span<F> f{const_cast<F *>(flags), n};
+    _segmented_scan_details::segmented_scan_flags<engine, true, ipt>(mem, s, f, T{}, op);
+    return mem.finish();
+}
+
+template <scan_engine engine = scan_engine::lookback, int ipt = scan_items_per_thread, class T, class F, class Op = std::plus<>>
+sycl::event segmented_exclusive_scan(sycl::queue &q, T *data, F const *flags, size_t n, T init, Op op = {},
+                                     std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<T> s{data, n};
+    usm_span<F> f{const_cast<F *>(flags), n};
+    _segmented_scan_details::segmented_scan_flags<engine, false, ipt>(mem, s, f, init, op);
+    return mem.finish();
+}
+
+template <scan_engine engine = scan_engine::lookback, int ipt = scan_items_per_thread, class K, class T, class Op = std::plus<>>
+sycl::event inclusive_scan_by_key(sycl::queue &q, K const *keys, T *data, size_t n, Op op = {},
+                                  std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<K> k{const_cast<K *>(keys), n};
+    usm_span<T> s{data, n};
+    _segmented_scan_details::scan_by_key<engine, true, ipt>(mem, k, s, T{}, op);
+    return mem.finish();
+}
+
+template <scan_engine engine = scan_engine::lookback, int ipt = scan_items_per_thread, class K, class T, class Op = std::plus<>>
+sycl::event exclusive_scan_by_key(sycl::queue &q, K const *keys, T *data, size_t n, T init, Op op = {},
+                                  std::vector<sycl::event> const &deps = {}, temp_storage const &temp = {}) {
+    usm_memory mem{q, deps, temp};
+    usm_span<K> k{const_cast<K *>(keys), n};
+    usm_span<T> s{data, n};
+    _segmented_scan_details::scan_by_key<engine, false, ipt>(mem, k, s, init, op);
+    return mem.finish();
+}
+
+// bytes of temp_storage the USM segmented scans and scans by key of n
+// elements of T need
+template <scan_engine engine = scan_engine::lookback, int ipt = scan_items_per_thread, class T>
+size_t segmented_scan_temp_storage_bytes(sycl::queue &q, size_t n) {
+    usm_memory mem{q, usm_memory::measure_tag{}};
+    usm_span<T> s{nullptr, n};
+    usm_span<unsigned> f{nullptr, n};
+    _segmented_scan_details::segmented_scan_flags<engine, true, ipt>(mem, s, f, T{}, std::plus<>{});
+    return mem.used_bytes();
+}
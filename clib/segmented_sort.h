@@ -0,0 +1,178 @@
+#pragma once
+
+#include <sycl/sycl.hpp>
+#include <vector>
+#include <algorithm>
+#include "exclusive_scan.h"
+#include "radix_sort.h"
+
+template <class T, class I>
+class KT_segmented_sort_classify;
+template <class T, class I>
+class KT_segmented_sort_local;
+template <class T, class I>
+class KT_segmented_sort_gather;
+template <class T, class I>
+class KT_segmented_sort_scatter;
+
+namespace _segmented_sort_details {
+
+// largest segment a work-group sorts in local memory: two ping-pong copies
+// of the keys next to the 10 KiB of counts and rank bitmasks of round_rank;
+// only the cutoff of the local path, its kernel reserves what the largest
+// segment routed to it needs
+template <class T>
+size_t local_capacity(sycl::queue &q) {
+    size_t local_mem = q.get_device().get_info<sycl::info::device::local_mem_size>();
+    size_t reserved = (256 + 256 * 9) * sizeof(unsigned);
+    size_t cap = local_mem > reserved ? (local_mem - reserved) / (2 * sizeof(T)) : 0;
+    return std::min<size_t>(cap / 256 * 256, 16384);
+}
+
+// what the segments up to one hold: how many go to the local path and how
+// many are larger, with the keys of the latter, and the longest of the
+// former
+struct segment_counts {
+    size_t small;
+    size_t large;
+    size_t large_keys;
+    size_t small_max;
+};
+
+struct segment_counts_op {
+    segment_counts operator()(segment_counts const &a, segment_counts const &b) const {
+        return {a.small + b.small, a.large + b.large, a.large_keys + b.large_keys, std::max(a.small_max, b.small_max)};
+    }
+};
+
+}
+
+// sorts keys[offsets[s], offsets[s + 1]) for every segment s independently,
+// offsets holds segments + 1 ascending positions into keys; a scan on the
+// device lists the segments small enough for local memory, which are
+// sorted by one work-group each in a single launch, and the larger ones,
+// whose keys are sorted together by one device-wide radix sort of (segment,
+// key) pairs over just the bits of the segment numbers; only the totals of
+// that scan come back to the host, to size the launches
+template <class T, class I>
+void segmented_radix_sort(sycl::queue &q, sycl::buffer<T> &keys, sycl::buffer<I> &offsets) {
+    using namespace _radix_sort_details;
+    using _segmented_sort_details::segment_counts;
+    if (offsets.size() <= 1) return;
+    size_t segments = offsets.size() - 1;
+    size_t cap = _segmented_sort_details::local_capacity<T>(q);
+    buffer_memory mem{q};
+    sycl::buffer<unsigned> small_ids{segments};
+    sycl::buffer<unsigned> large_ids{segments};
+    // where the keys of every large segment start among all of theirs
+    sycl::buffer<size_t> large_begin{segments};
+    sycl::buffer<segment_counts> totals{1};
+    _exclusive_scan_details::scan_lookback<false, scan_items_per_thread, KT_segmented_sort_classify<T, I>>(mem, segments, [&] (sycl::handler &cgh) {
+        sycl::accessor off{offsets, cgh, sycl::read_only};
+        sycl::accessor sid{small_ids, cgh, sycl::write_only, sycl::no_init};
+        sycl::accessor lid{large_ids, cgh, sycl::write_only, sycl::no_init};
+        sycl::accessor lbegin{large_begin, cgh, sycl::write_only, sycl::no_init};
+        sycl::accessor tot{totals, cgh, sycl::write_only, sycl::no_init};
+        auto classify = [=] (size_t s) {
+            size_t len = off[s + 1] - off[s];
+            bool small = len > 1 && len <= cap;
+            return segment_counts{small, len > cap, len > cap ? len : 0, small ? len : 0};
+        };
+        return _exclusive_scan_details::scan_io{classify, [=] (size_t s, segment_counts const &v) {
+            segment_counts c = classify(s);
+            if (c.small)
+                sid[v.small] = s;
+            if (c.large) {
+                lid[v.large] = s;
+                lbegin[v.large] = v.large_keys;
+            }
+            if (s == segments - 1)
+                tot[0] = _segmented_sort_details::segment_counts_op{}(v, c);
+        }};
+    }, true, segment_counts{0, 0, 0, 0}, _segmented_sort_details::segment_counts_op{});
+    segment_counts total = mem.to_host(totals)[0];
+    if (total.small) {
+        // the ping-pong halves of local_keys, sized for the largest small
+        // segment so tiny segments leave room for more work-groups
+        size_t half = (total.small_max + 255) / 256 * 256;
+        q.submit([&] (sycl::handler &cgh) {
+            sycl::local_accessor<T> local_keys{half * 2, cgh};
+            sycl::local_accessor<unsigned> count{256, cgh};
+            sycl::local_accessor<unsigned> bits{256 * 9, cgh};
+            sycl::accessor ids{small_ids, cgh, sycl::read_only};
+            sycl::accessor off{offsets, cgh, sycl::read_only};
+            sycl::accessor a{keys, cgh, sycl::read_write};
+            cgh.parallel_for<KT_segmented_sort_local<T, I>>(sycl::nd_range<1>{total.small * 256, 256}, [=] (sycl::nd_item<1> it) {
+                int ii = it.get_local_id(0);
+                int gi = it.get_group(0);
+                unsigned s = ids[gi];
+                size_t begin = off[s];
+                size_t len = off[s + 1] - begin;
+                for (size_t j = ii; j < len; j += 256) {
+                    local_keys[j] = a[begin + j];
+                }
+                for (int p = 0; p < radix_bits<T> / 8; p++) {
+                    size_t src = p % 2 * half;
+                    size_t dst = (p + 1) % 2 * half;
+                    group_radix_pass(it, bits, count, len, [&] (size_t j) {
+                        return radix_digit(local_keys[src + j], p * 8);
+                    }, [&] (size_t j, unsigned index) {
+                        local_keys[dst + index] = local_keys[src + j];
+                    });
+                }
+                size_t res = radix_bits<T> / 8 % 2 * half;
+                for (size_t j = ii; j < len; j += 256) {
+                    a[begin + j] = local_keys[res + j];
+                }
+            });
+        });
+    }
+    if (total.large) {
+        size_t large = total.large;
+        size_t n = total.large_keys;
+        sycl::buffer<T> large_keys{n};
+        sycl::buffer<unsigned> large_seg{n};
+        q.submit([&] (sycl::handler &cgh) {
+            sycl::accessor ids{large_ids, cgh, sycl::read_only};
+            sycl::accessor lbegin{large_begin, cgh, sycl::read_only};
+            sycl::accessor off{offsets, cgh, sycl::read_only};
+            sycl::accessor a{keys, cgh, sycl::read_only};
+            sycl::accessor lk{large_keys, cgh, sycl::write_only, sycl::no_init};
+            sycl::accessor ls{large_seg, cgh, sycl::write_only, sycl::no_init};
+            cgh.parallel_for<KT_segmented_sort_gather<T, I>>(sycl::range<1>{n}, [=] (sycl::id<1> i) {
+                // the last large segment starting at or before i
+                size_t lo = 0, hi = large;
+                while (hi - lo > 1) {
+                    size_t mid = (lo + hi) / 2;
+                    if (lbegin[mid] <= i[0])
+                        lo = mid;
+                    else
+                        hi = mid;
+                }
+                lk[i] = a[off[ids[lo]] + i[0] - lbegin[lo]];
+                ls[i] = lo;
+            });
+        });
+        // by key, then stably by segment: the order of the (segment, key)
+        // pairs
+        int seg_bits = 0;
+        while (size_t(1) << seg_bits < large)
+            seg_bits++;
+        radix_sort_by_key(q, large_keys, large_seg);
+        radix_sort_options by_segment;
+        by_segment.end_bit = seg_bits;
+        radix_sort_by_key(q, by_segment, large_seg, large_keys);
+        q.submit([&] (sycl::handler &cgh) {
+            sycl::accessor ids{large_ids, cgh, sycl::read_only};
+            sycl::accessor lbegin{large_begin, cgh, sycl::read_only};
+            sycl::accessor off{offsets, cgh, sycl::read_only};
+            sycl::accessor lk{large_keys, cgh, sycl::read_only};
+            sycl::accessor ls{large_seg, cgh, sycl::read_only};
+            sycl::accessor a{keys, cgh, sycl::write_only};
+            cgh.parallel_for<KT_segmented_sort_scatter<T, I>>(sycl::range<1>{n}, [=] (sycl::id<1> i) {
+                unsigned r = ls[i];
+                a[off[ids[r]] + i[0] - lbegin[r]] = lk[i];
+            });
+        });
+    }
+}
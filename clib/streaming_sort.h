@@ -0,0 +1,176 @@
+#pragma once
+
+#include <sycl/sycl.hpp>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include "device_memory.h"
+#include "radix_sort.h"
+#include "radix_traits.h"
+
+struct streaming_sort_options {
+    // bytes of device memory the sort holds at most, keys and temporaries of
+    // every chunk in flight; 0 is half the device's global memory
+    size_t device_budget = 0;
+    // chunks in flight: 2 uploads and downloads one chunk while another is
+    // sorted, 3 also overlaps the upload of one with the download of another
+    int pipeline_depth = 2;
+    // threads of the host merge of the sorted chunks, 0 is all of them
+    unsigned merge_threads = 0;
+    // how every chunk is sorted
+    radix_sort_options sort;
+};
+
+namespace _streaming_sort_details {
+
+// the largest chunk of which depth copies, each with its radix_sort
+// temp_storage, fit in budget bytes
+template <radix_sort_engine engine, int ipt, class T>
+size_t chunk_size(sycl::queue &q, size_t n, int depth, size_t budget, radix_sort_options const &opts) {
+    size_t chunk = std::min(n, budget / (depth * sizeof(T)));
+    while (chunk > 0 && depth * (chunk * sizeof(T) + radix_sort_temp_storage_bytes<engine, ipt, T>(q, chunk, opts)) > budget) {
+        chunk = chunk / 8 * 7;
+    }
+    return chunk;
+}
+
+// out = the merge of the sorted runs in[bounds[r], bounds[r + 1]): the
+// output is cut into one part per thread at splitters sampled from the
+// runs, and every thread merges its slice of every run through a heap
+template <class T>
+void merge_sorted_runs(T const *in, std::vector<size_t> const &bounds, T *out, unsigned threads) {
+    radix_less<T> less;
+    size_t runs = bounds.size() - 1;
+    size_t n = bounds.back();
+    size_t parts = std::max<size_t>(std::min<size_t>(threads, n / 65536), 1);
+    std::vector<T> samples;
+    size_t stride = std::max<size_t>(n / (parts * 64), 1);
+    for (size_t r = 0; r < runs; r++) {
+        for (size_t k = bounds[r] + stride / 2; k < bounds[r + 1]; k += stride) {
+            samples.push_back(in[k]);
+        }
+    }
+    std::sort(samples.begin(), samples.end(), less);
+    // cut[t][r] = where part t starts in run r
+    std::vector<std::vector<size_t>> cut(parts + 1, std::vector<size_t>(runs));
+    for (size_t r = 0; r < runs; r++) {
+        cut[0][r] = bounds[r];
+        cut[parts][r] = bounds[r + 1];
+        for (size_t t = 1; t < parts; t++) {
+            T const &s = samples[samples.size() * t / parts];
+            cut[t][r] = std::lower_bound(in + cut[t - 1][r], in + bounds[r + 1], s, less) - in;
+        }
+    }
+    std::vector<size_t> part_begin(parts + 1, 0);
+    for (size_t t = 0; t < parts; t++) {
+        part_begin[t + 1] = part_begin[t];
+        for (size_t r = 0; r < runs; r++) {
+            part_begin[t + 1] += cut[t + 1][r] - cut[t][r];
+        }
+    }
+    auto merge_part = [&] (size_t t) {
+        using head = std::pair<T, size_t>;
+        auto after = [&] (head const &a, head const &b) {
+            return less(b.first, a.first) || (!less(a.first, b.first) && a.second > b.second);
+        };
+        std::priority_queue<head, std::vector<head>, decltype(after)> heap{after};
+        std::vector<size_t> pos(cut[t]);
+        for (size_t r = 0; r < runs; r++) {
+            if (pos[r] < cut[t + 1][r])
+                heap.emplace(in[pos[r]], r);
+        }
+        T *o = out + part_begin[t];
+        while (!heap.empty()) {
+            auto [x, r] = heap.top();
+            heap.pop();
+            *o++ = x;
+            if (++pos[r] < cut[t + 1][r])
+                heap.emplace(in[pos[r]], r);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < parts; t++) {
+        workers.emplace_back(merge_part, t);
+    }
+    merge_part(0);
+    for (auto &w: workers) {
+        w.join();
+    }
+}
+
+}
+
+// sorts the host array keys[0, n) in place through a device that cannot
+// hold it: chunks sized to opts.device_budget are uploaded, radix sorted and
+// downloaded through pinned staging memory, pipeline_depth chunks in
+// flight so transfers overlap the sorts (on an out-of-order queue), then
+// the sorted chunks are merged on the host by several threads; needs n more
+// keys of host memory when there is more than one chunk
+template <radix_sort_engine engine = radix_sort_engine::classic, int ipt = radix_sort_items_per_thread, class T>
+void streaming_sort(sycl::queue &q, T *keys, size_t n, streaming_sort_options const &opts = {}) {
+    if (n <= 1) return;
+    int depth = std::max(opts.pipeline_depth, 1);
+    size_t budget = opts.device_budget ? opts.device_budget
+                  : q.get_device().get_info<sycl::info::device::global_mem_size>() / 2;
+    size_t chunk = _streaming_sort_details::chunk_size<engine, ipt, T>(q, n, depth, budget, opts.sort);
+    if (chunk == 0)
+        throw std::length_error("streaming_sort: device_budget below a single chunk");
+    size_t temp_bytes = radix_sort_temp_storage_bytes<engine, ipt, T>(q, chunk, opts.sort);
+    struct slot {
+        T *dev;
+        void *temp;
+        T *staging;
+        sycl::event done;
+        size_t begin = 0;
+        size_t len = 0;
+    };
+    std::vector<slot> slots(depth);
+    for (auto &s: slots) {
+        s.dev = sycl::malloc_device<T>(chunk, q);
+        s.temp = sycl::malloc_device(std::max<size_t>(temp_bytes, 1), q);
+        s.staging = sycl::malloc_host<T>(chunk, q);
+    }
+    // the sorted chunk of a slot goes back into keys before the slot is reused
+    auto retire = [&] (slot &s) {
+        s.done.wait();
+        std::copy(s.staging, s.staging + s.len, keys + s.begin);
+        s.len = 0;
+    };
+    size_t chunks = (n + chunk - 1) / chunk;
+    for (size_t c = 0; c < chunks; c++) {
+        slot &s = slots[c % depth];
+        retire(s);
+        s.begin = c * chunk;
+        s.len = std::min(chunk, n - s.begin);
+        std::copy(keys + s.begin, keys + s.begin + s.len, s.staging);
+        sycl::event up = q.memcpy(s.dev, s.staging, s.len * sizeof(T));
+        radix_sort_options sort = opts.sort;
+        sort.temp = temp_storage{s.temp, temp_bytes};
+        sycl::event sorted = radix_sort<engine, ipt>(q, s.dev, s.len, {up}, sort);
+        s.done = q.memcpy(s.staging, s.dev, s.len * sizeof(T), std::vector<sycl::event>{sorted});
+    }
+    for (auto &s: slots) {
+        retire(s);
+        sycl::free(s.dev, q);
+        sycl::free(s.temp, q);
+        sycl::free(s.staging, q);
+    }
+    if (chunks == 1) return;
+    std::vector<size_t> bounds;
+    for (size_t c = 0; c < chunks; c++) {
+        bounds.push_back(c * chunk);
+    }
+    bounds.push_back(n);
+    std::vector<T> out(n);
+    unsigned threads = opts.merge_threads ? opts.merge_threads : std::max(std::thread::hardware_concurrency(), 1u);
+    _streaming_sort_details::merge_sorted_runs(keys, bounds, out.data(), threads);
+    std::copy(out.begin(), out.end(), keys);
+}
+
+template <radix_sort_engine engine = radix_sort_engine::classic, int ipt = radix_sort_items_per_thread, class T>
+void streaming_sort(sycl::queue &q, std::vector<T> &keys, streaming_sort_options const &opts = {}) {
+    streaming_sort<engine, ipt>(q, keys.data(), keys.size(), opts);
+}
@@ -78,3 +78,27 @@ inline sycl::context create_default_sycl_context() {
         select_sycl_devices(),
         [] (sycl::exception_list el) { for (auto e: el) { std::rethrow_exception(e); } });
 }
+
+// every CPU device that can be partitioned by NUMA node is replaced by its
+// per-node sub-devices, so a multi-queue algorithm scales across sockets
+inline std::vector<sycl::device> partition_cpu_devices
+( std::vector<sycl::device> const &devs = select_sycl_devices()
+) {
+    std::vector<sycl::device> parts;
+    for (auto const &dev: devs) {
+        std::vector<sycl::device> subs;
+        if (dev.is_cpu() && dev.get_info<sycl::info::device::partition_max_sub_devices>() > 1) {
+            try {
+                subs = dev.create_sub_devices<sycl::info::partition_property::partition_by_affinity_domain>(
+                    sycl::info::partition_affinity_domain::numa);
+            } catch (sycl::exception const &) {
+            }
+        }
+        if (subs.size() > 1) {
+            parts.insert(parts.end(), subs.begin(), subs.end());
+        } else {
+            parts.push_back(dev);
+        }
+    }
+    return parts;
+}
@@ -1,23 +1,27 @@
 #include "utils/wangshash.h"
 #include "clib/print_buffer.h"
 #include "clib/radix_sort.h"
+#include "clib/multi_device_sort.h"
+#include "clib/sycl_context_manager.h"
 #include <vector>
 #include <execution>
 #include "utils/ticktock.h"
 
 int main() {
     constexpr size_t n = 4 * 256 * 256 * 256;
+    radix_sort_options device_opts;
+    device_opts.backend = radix_sort_backend::device;
     {
         sycl::queue q{sycl::gpu_selector_v};
         std::cerr << q.get_device().get_info<sycl::info::device::name>() << std::endl;
         std::vector<unsigned> arr(n);
-        for (int i = 0; i < arr.size(); i++) {
+        for (size_t i = 0; i < arr.size(); i++) {
             arr[i] = wangshash(i)();
         }
         TICK(radix);
         {
             sycl::buffer<unsigned> buf{arr};
-            radix_sort(q, buf);
+            radix_sort(q, buf, device_opts);
             q.wait();
         }
         TOCK(radix);
@@ -28,9 +32,43 @@ int main() {
             print_buffer(arr);
         }
     }
+    {
+        std::vector<sycl::queue> queues;
+        for (auto const &dev: partition_cpu_devices()) {
+            queues.emplace_back(dev);
+        }
+        std::vector<unsigned> arr(n);
+        for (size_t i = 0; i < arr.size(); i++) {
+            arr[i] = wangshash(i)();
+        }
+        multi_device_sort_options opts;
+        opts.sort = device_opts;
+        // measured apart so that TICK(multi) times the sort alone
+        TICK(multi_throughput);
+        opts.throughput = measure_sort_throughput(queues, arr.data(), arr.size(), opts.sort);
+        TOCK(multi_throughput);
+        TICK(multi);
+        multi_device_sort(queues, arr, opts);
+        TOCK(multi);
+        if (!std::is_sorted(arr.begin(), arr.end())) {
+            printf("multi-device sort failed\n");
+        }
+    }
+    {
+        std::vector<unsigned> arr(n);
+        for (size_t i = 0; i < arr.size(); i++) {
+            arr[i] = wangshash(i)();
+        }
+        TICK(host_radix);
+        host_radix_sort(arr);
+        TOCK(host_radix);
+        if (!std::is_sorted(arr.begin(), arr.end())) {
+            printf("host radix sort failed\n");
+        }
+    }
     {
         std::vector<unsigned> arr(n);
-        for (int i = 0; i < arr.size(); i++) {
+        for (size_t i = 0; i < arr.size(); i++) {
             arr[i] = wangshash(i)();
         }
         TICK(tbb);